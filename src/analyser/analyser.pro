@@ -0,0 +1,36 @@
+#------------------------------------------------#
+#                                                #
+# Brain Controlled Scalextrix Session Analyser   #
+#                                                #
+# Produced by the Warwick Biomedical Engineering #
+# Outreach Group at the University of Warwick    #
+#                                                #
+#                                                #
+# Software Released Under LGPL-v2.1              #
+#                                                #
+#------------------------------------------------#
+
+QT       += core
+QT       -= gui
+
+CONFIG += C++11 thread
+
+TARGET    = bci-analyser
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../pc
+
+SOURCES += \
+        main.cpp \
+        sessionstatistics.cpp \
+        workstealingpool.cpp \
+        ../pc/thinkgearstreamparser.cpp
+
+HEADERS += \
+        sessionstatistics.h \
+        workstealingpool.h \
+        ../pc/thinkgearstreamparser.h \
+        ../pc/defines.h
@@ -0,0 +1,106 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QDebug>
+
+#include <vector>
+
+#include "./sessionstatistics.h"
+#include "./workstealingpool.h"
+
+//! Offline analyser for recorded MindWaveMobile sessions.
+//!
+//! Every file in the given directory is treated as a raw ThinkGear byte stream. Sessions are
+//! decoded in parallel and written as one tab separated table, one row per session followed
+//! by a row for all sessions combined.
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser arguments;
+    arguments.setApplicationDescription("Summarise recorded ThinkGear sessions");
+    arguments.addHelpOption();
+    arguments.addPositionalArgument("directory", "Directory of recorded ThinkGear byte streams");
+
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Number of worker threads (default: one per core)", "count", "0");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Write the summary table to a file instead of stdout", "file");
+    arguments.addOption(threadsOption);
+    arguments.addOption(outputOption);
+    arguments.process(app);
+
+    if (arguments.positionalArguments().size() != 1) {
+        qDebug() << "Invalid Arguments provided";
+        arguments.showHelp(1);
+    }
+
+    QDir directory(arguments.positionalArguments().at(0));
+    if (!directory.exists()) {
+        qDebug() << "Directory does not exist:" << directory.path();
+        return 2;
+    }
+
+    QFileInfoList files = directory.entryInfoList(QDir::Files, QDir::Name);
+    if (files.isEmpty()) {
+        qDebug() << "No recorded sessions found in" << directory.path();
+        return 2;
+    }
+
+    // each task writes only its own slot so results need no locking
+    std::vector<SessionStatistics> results(files.size());
+
+    QElapsedTimer timer;
+    timer.start();
+    {
+        WorkStealingPool pool(arguments.value(threadsOption).toInt());
+
+        for (int i = 0; i != files.size(); i++) {
+            QString path = files.at(i).filePath();
+            QString name = files.at(i).fileName();
+
+            pool.submit([&results, i, path, name]() {
+                QFile file(path);
+                if (!file.open(QIODevice::ReadOnly)) {
+                    results[i].name = name;
+                    results[i].readFailed = true;
+                    return;
+                }
+
+                results[i] = SessionStatistics::analyse(name, file.readAll());
+            });
+        }
+
+        pool.wait();
+        qDebug() << "Analysed" << files.size() << "sessions in" << timer.elapsed() << "ms using"
+                 << pool.threadCount() << "threads";
+    }
+
+    SessionStatistics total;
+    total.name = "TOTAL";
+    for (const auto &session : results) {
+        total.merge(session);
+    }
+
+    QFile outputFile;
+    if (arguments.isSet(outputOption)) {
+        outputFile.setFileName(arguments.value(outputOption));
+        if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qDebug() << "Failed to open output file" << outputFile.fileName();
+            return 3;
+        }
+    } else {
+        outputFile.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+
+    QTextStream out(&outputFile);
+    SessionStatistics::writeHeader(out);
+    for (const auto &session : results) {
+        session.writeRow(out);
+    }
+    total.writeRow(out);
+
+    return 0;
+}
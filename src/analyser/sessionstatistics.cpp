@@ -0,0 +1,216 @@
+#include "./sessionstatistics.h"
+
+#include <cmath>
+#include <initializer_list>
+
+#include "../pc/thinkgearstreamparser.h"
+
+static const char *bandNames[8] = {"delta", "theta", "lowAlpha", "highAlpha",
+                                   "lowBeta", "highBeta", "lowGamma", "midGamma"};
+
+//! \brief Decode a recorded byte stream with the ThinkGear stream parser
+SessionStatistics SessionStatistics::analyse(const QString &name, const QByteArray &stream) {
+    SessionStatistics stats;
+    stats.name  = name;
+    stats.bytes = stream.size();
+
+    ThinkGearStreamParser parser;
+    THINKGEAR_initParser(&parser, PARSER_TYPE_PACKETS, &SessionStatistics::handleDataValue, &stats);
+
+    const uchar *data = reinterpret_cast<const uchar*>(stream.constData());
+    for (int i = 0; i != stream.size(); i++) {
+        switch (THINKGEAR_parseByte(&parser, data[i])) {
+        case 1:
+            stats.packets++;
+            break;
+
+        case -2:
+            stats.checksumErrors++;
+            break;
+
+        case -3:
+        case -4:
+            stats.framingErrors++;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return stats;
+}
+
+void SessionStatistics::handleDataValue(uchar extendedCodeLevel,
+                                        uchar code,
+                                        uchar valueLength,
+                                        const uchar *value,
+                                        void *customData) {
+    SessionStatistics *stats = static_cast<SessionStatistics*>(customData);
+
+    if (extendedCodeLevel != 0) {
+        return;
+    }
+
+    switch (code) {
+    case PARSER_CODE_POOR_QUALITY:
+        if (value[0] != 0) {
+            stats->poorSignal++;
+        }
+        break;
+
+    case PARSER_CODE_ATTENTION:
+        if (value[0] <= 100) {
+            stats->attention[value[0]]++;
+        }
+        break;
+
+    case PARSER_CODE_MEDITATION:
+        if (value[0] <= 100) {
+            stats->meditation[value[0]]++;
+        }
+        break;
+
+    case PARSER_CODE_RAW_SIGNAL:
+        stats->rawSamples++;
+        break;
+
+    case PARSER_CODE_ASIC_EEG_POWER_INT: {
+        if (valueLength < 24) {
+            break;
+        }
+
+        // eight 3 byte big endian band powers
+        double band[8];
+        double total = 0.0;
+        for (int i = 0; i != 8; i++) {
+            band[i] = (value[i*3]<<16) | (value[i*3+1]<<8) | value[i*3+2];
+            total += band[i];
+        }
+
+        if (total > 0.0) {
+            for (int i = 0; i != 8; i++) {
+                stats->bandPowerSum[i] += band[i] / total;
+            }
+            stats->bandPowerCount++;
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void SessionStatistics::merge(const SessionStatistics &other) {
+    readFailed     |= other.readFailed;
+    bytes          += other.bytes;
+    packets        += other.packets;
+    checksumErrors += other.checksumErrors;
+    framingErrors  += other.framingErrors;
+    rawSamples     += other.rawSamples;
+    poorSignal     += other.poorSignal;
+
+    for (int i = 0; i != 101; i++) {
+        attention[i]  += other.attention[i];
+        meditation[i] += other.meditation[i];
+    }
+
+    for (int i = 0; i != 8; i++) {
+        bandPowerSum[i] += other.bandPowerSum[i];
+    }
+    bandPowerCount += other.bandPowerCount;
+}
+
+//! \brief Fraction of complete packets which failed their checksum
+double SessionStatistics::checksumErrorRate() const {
+    quint64 total = packets + checksumErrors;
+    return total ? static_cast<double>(checksumErrors) / total : 0.0;
+}
+
+distribution_t SessionStatistics::distribution(const quint64 *histogram, int size) {
+    distribution_t result;
+
+    double sum = 0.0;
+    for (int i = 0; i != size; i++) {
+        result.count += histogram[i];
+        sum += static_cast<double>(i) * histogram[i];
+    }
+
+    if (result.count == 0) {
+        return result;
+    }
+
+    result.mean = sum / result.count;
+
+    double squares = 0.0;
+    for (int i = 0; i != size; i++) {
+        squares += (i - result.mean) * (i - result.mean) * histogram[i];
+    }
+    result.stddev = result.count > 1 ? std::sqrt(squares / (result.count - 1)) : 0.0;
+
+    // percentiles are the first value whose cumulative count reaches the rank
+    quint64 rank10 = (result.count * 10 + 99) / 100;
+    quint64 rank50 = (result.count * 50 + 99) / 100;
+    quint64 rank90 = (result.count * 90 + 99) / 100;
+    quint64 cumulative = 0;
+    bool found10 = false, found50 = false, found90 = false;
+    for (int i = 0; i != size; i++) {
+        cumulative += histogram[i];
+        if (!found10 && cumulative >= rank10) { result.p10    = i; found10 = true; }
+        if (!found50 && cumulative >= rank50) { result.median = i; found50 = true; }
+        if (!found90 && cumulative >= rank90) { result.p90    = i; found90 = true; }
+    }
+
+    return result;
+}
+
+//! \brief Write the tab separated column names of the summary table
+void SessionStatistics::writeHeader(QTextStream &out) {
+    out << "session\tbytes\tpackets\tchecksumErrors\tchecksumErrorRate\tframingErrors"
+        << "\trawSamples\tpoorSignal";
+
+    for (const char *prefix : {"attention", "meditation"}) {
+        out << '\t' << prefix << "Count"
+            << '\t' << prefix << "Mean"
+            << '\t' << prefix << "Stddev"
+            << '\t' << prefix << "P10"
+            << '\t' << prefix << "Median"
+            << '\t' << prefix << "P90";
+    }
+
+    for (int i = 0; i != 8; i++) {
+        out << '\t' << bandNames[i];
+    }
+
+    out << '\n';
+}
+
+//! \brief Write one row of the summary table, band powers are mean relative power
+void SessionStatistics::writeRow(QTextStream &out) const {
+    out << name << (readFailed ? " (read failed)" : "")
+        << '\t' << bytes
+        << '\t' << packets
+        << '\t' << checksumErrors
+        << '\t' << QString::number(checksumErrorRate(), 'f', 5)
+        << '\t' << framingErrors
+        << '\t' << rawSamples
+        << '\t' << poorSignal;
+
+    for (const quint64 *histogram : {attention, meditation}) {
+        distribution_t d = distribution(histogram, 101);
+        out << '\t' << d.count
+            << '\t' << QString::number(d.mean, 'f', 2)
+            << '\t' << QString::number(d.stddev, 'f', 2)
+            << '\t' << d.p10
+            << '\t' << d.median
+            << '\t' << d.p90;
+    }
+
+    for (int i = 0; i != 8; i++) {
+        double mean = bandPowerCount ? bandPowerSum[i] / bandPowerCount : 0.0;
+        out << '\t' << QString::number(mean, 'f', 4);
+    }
+
+    out << '\n';
+}
@@ -0,0 +1,60 @@
+#ifndef SESSIONSTATISTICS_H
+#define SESSIONSTATISTICS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QTextStream>
+
+#include "../pc/defines.h"
+
+//! \brief Summary of a histogram of integer values
+typedef struct _distribution_t{
+    quint64 count  = 0;
+    double  mean   = 0.0;
+    double  stddev = 0.0;
+    int     p10    = 0;
+    int     median = 0;
+    int     p90    = 0;
+}distribution_t;
+
+//! \title SessionStatistics
+//!
+//! \brief Statistics of one recorded ThinkGear byte stream, or of several merged together.
+//!
+class SessionStatistics {
+ public:
+    QString name;
+    bool    readFailed = false;
+
+    quint64 bytes          = 0;
+    quint64 packets        = 0;  // packets with a valid checksum
+    quint64 checksumErrors = 0;
+    quint64 framingErrors  = 0;  // invalid payload lengths
+    quint64 rawSamples     = 0;
+    quint64 poorSignal     = 0;  // poor signal reports with a non-zero value
+
+    quint64 attention[101]  = {};
+    quint64 meditation[101] = {};
+
+    double  bandPowerSum[8] = {};  // relative ASIC EEG band power, summed over reports
+    quint64 bandPowerCount  = 0;
+
+    static SessionStatistics analyse(const QString &name, const QByteArray &stream);
+
+    void merge(const SessionStatistics &other);
+
+    double checksumErrorRate() const;
+    static distribution_t distribution(const quint64 *histogram, int size);
+
+    static void writeHeader(QTextStream &out);
+    void writeRow(QTextStream &out) const;
+
+ private:
+    static void handleDataValue(uchar extendedCodeLevel,
+                                uchar code,
+                                uchar valueLength,
+                                const uchar *value,
+                                void *customData);
+};
+
+#endif  // SESSIONSTATISTICS_H
@@ -0,0 +1,115 @@
+#include "./workstealingpool.h"
+
+//! \brief Start the workers, a thread count of 0 uses one thread per core
+WorkStealingPool::WorkStealingPool(int threadCount)
+    : m_queued(0), m_nextQueue(0) {
+    if (threadCount <= 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount <= 0) {
+        threadCount = 1;
+    }
+
+    for (int i = 0; i != threadCount; i++) {
+        m_queues.emplace_back(new WorkerQueue);
+    }
+
+    for (int i = 0; i != threadCount; i++) {
+        m_threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+//! \brief Finish all queued tasks and join the workers
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    size_t index = m_nextQueue++ % m_queues.size();
+
+    {
+        // counted before the task is published so a worker finishing or stealing it can never
+        // take the counters below zero, and under the state mutex so a sleeping worker sees it
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_pending++;
+        m_queued++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    m_workAvailable.notify_one();
+}
+
+//! \brief Block until every submitted task has finished
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    m_allDone.wait(lock, [this]{ return m_pending == 0; });
+}
+
+int WorkStealingPool::threadCount() const {
+    return static_cast<int>(m_threads.size());
+}
+
+void WorkStealingPool::run(int index) {
+    for (;;) {
+        Task task;
+        if (popLocal(index, task) || steal(index, task)) {
+            task();
+
+            std::lock_guard<std::mutex> lock(m_stateMutex);
+            if (--m_pending == 0) {
+                m_allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_stateMutex);
+        m_workAvailable.wait(lock, [this]{ return m_stopping || m_queued > 0; });
+        if (m_stopping && m_queued == 0) {
+            return;
+        }
+    }
+}
+
+//! \brief Take the most recently queued task from a worker's own queue
+bool WorkStealingPool::popLocal(int index, Task &task) {
+    WorkerQueue &queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    m_queued--;
+    return true;
+}
+
+//! \brief Take the oldest task from another worker's queue
+bool WorkStealingPool::steal(int index, Task &task) {
+    size_t count = m_queues.size();
+    for (size_t i = 1; i < count; i++) {
+        WorkerQueue &queue = *m_queues[(index + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        m_queued--;
+        return true;
+    }
+
+    return false;
+}
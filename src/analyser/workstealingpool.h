@@ -0,0 +1,56 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! \title WorkStealingPool
+//!
+//! \brief Fixed size thread pool where idle workers steal queued tasks from busy ones.
+//!
+//! Each worker owns a task queue. Tasks are handed out round robin on submit(); a worker
+//! takes from the back of its own queue and, once that is empty, from the front of the
+//! others, so a few long tasks do not leave the remaining cores idle.
+//!
+class WorkStealingPool {
+ public:
+    typedef std::function<void()> Task;
+
+    explicit WorkStealingPool(int threadCount = 0);
+    ~WorkStealingPool();
+
+    void submit(Task task);
+    void wait();
+
+    int threadCount() const;
+
+ private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_stateMutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+    std::atomic<size_t> m_queued;   // tasks waiting in any queue
+    size_t m_pending  = 0;          // tasks submitted but not finished, guarded by m_stateMutex
+    bool   m_stopping = false;      // guarded by m_stateMutex
+
+    std::atomic<size_t> m_nextQueue;
+
+    void run(int index);
+    bool popLocal(int index, Task &task);
+    bool steal(int index, Task &task);
+};
+
+#endif  // WORKSTEALINGPOOL_H
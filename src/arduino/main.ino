@@ -1,15 +1,80 @@
-const char SERIAL_CODE_PLAYER1      =  0x10;
+// Commands from the PC are framed the same way as the telemetry below, so a
+// corrupted or partial command is discarded instead of being misread as car speeds
+const byte COMMAND_SYNC             =  0xA5;
+
+const char SERIAL_CODE_PLAYER1      =  0x10;  // speed (0-100)
 const char SERIAL_CODE_PLAYER2      =  0x20;
+const char SERIAL_CODE_RAMP_PLAYER1 =  0x11;  // target speed and a 2 byte ramp time (ms)
+const char SERIAL_CODE_RAMP_PLAYER2 =  0x21;
+const char SERIAL_CODE_SLEW_PLAYER1 =  0x12;  // 2 byte max pwm change per tick (8.8 fixed point)
+const char SERIAL_CODE_SLEW_PLAYER2 =  0x22;
+const char SERIAL_CODE_PING         =  0x30;  // 4 byte token which is echoed back
+
+// Car outputs are interpolated towards their target at a fixed tick
+const unsigned long RAMP_TICK_MS    = 5;
+
+// Telemetry frames sent back to the PC are laid out as
+// [SYNC][TYPE][LENGTH][PAYLOAD...][CHKSUM] where CHKSUM is the inverted sum of
+// TYPE, LENGTH and PAYLOAD. Multi-byte values are sent MSB first.
+const byte TELEMETRY_SYNC           =  0xA5;
+const byte TELEMETRY_TYPE_STATUS    =  0x01;
+const byte TELEMETRY_TYPE_PONG      =  0x02;
+
+const unsigned long TELEMETRY_INTERVAL_MS = 250;
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
 
 const int car1Pin = 5;
 const int car2Pin = 6;
 
 typedef unsigned int uint;
 
-char car1State = 0;
-char car2State = 0;
+// Pwm values are held as 8.8 fixed point so slow ramps still advance every tick
+struct Lane {
+  long current;          // current pwm << 8
+  long target;           // target pwm << 8
+  long step;             // whole change per tick while ramping
+  long remainder;        // part of the change left over by step, spread over the ramp
+  long error;            // accumulated remainder not yet applied
+  uint ticks;            // length of the current ramp in ticks
+  uint ticksRemaining;   // ticks left in the current ramp
+  long maxSlew;          // max change per tick, 0 for unlimited
+};
+
+Lane car1 = {0, 0, 0, 0, 0, 0, 0, 0};
+Lane car2 = {0, 0, 0, 0, 0, 0, 0, 0};
+
+byte car1State = 0;
+byte car2State = 0;
+
+// Command parser states
+const byte PARSE_SYNC    = 0;
+const byte PARSE_TYPE    = 1;
+const byte PARSE_LENGTH  = 2;
+const byte PARSE_PAYLOAD = 3;
+const byte PARSE_CHKSUM  = 4;
+
+// Command parser state
+byte parseState = PARSE_SYNC;
+byte command = 0;
+byte commandBytesNeeded = 0;
+byte commandBytesReceived = 0;
+byte commandSum = 0;
+unsigned long commandMicros = 0;  // when the command's frame was completed
+byte buffer[0x10]; //16 element buffer
+
+// Telemetry counters
+uint rxOverruns  = 0;
+uint parseErrors = 0;
 
-char buffer[0x10]; //16 element buffer
+unsigned long lastLoopMicros  = 0;
+unsigned long loopPeriodSum   = 0;
+unsigned long loopPeriodMax   = 0;
+unsigned long loopCount       = 0;
+unsigned long lastTelemetryMs = 0;
+unsigned long lastRampMs      = 0;
 
 // Initialise Arduino on start
 void setup() {
@@ -17,41 +82,278 @@ void setup() {
   pinMode(car2Pin, OUTPUT);
 
   Serial.begin(9600); //serial port setup (baud rate)
+
+  lastLoopMicros  = micros();
+  lastTelemetryMs = millis();
+  lastRampMs      = lastTelemetryMs;
 }
 
 void loop() {
-  if(Serial.available() > 1) {
-    uint numBytes = 0;
+  unsigned long now = micros();
+  unsigned long period = now - lastLoopMicros;
+  lastLoopMicros = now;
+
+  loopPeriodSum += period;
+  loopCount++;
+  if (period > loopPeriodMax) {
+      loopPeriodMax = period;
+  }
+
+  // a full receive buffer means the hardware serial has likely dropped bytes
+  if (Serial.available() >= SERIAL_RX_BUFFER_SIZE - 1) {
+      rxOverruns++;
+  }
 
-    while(Serial.available()) {
-        buffer[numBytes++] = Serial.read();
-    }
+  while (Serial.available()) {
+      parseByte(Serial.read());
+  }
+
+  if (millis() - lastRampMs >= RAMP_TICK_MS) {
+      lastRampMs += RAMP_TICK_MS;
+
+      car1State = updateLane(car1);
+      car2State = updateLane(car2);
 
-    parseBuffer(numBytes);
+      analogWrite(car1Pin, car1State);
+      analogWrite(car2Pin, car2State);
   }
 
-  analogWrite(car1Pin, car1State);
-  analogWrite(car2Pin, car2State);
+  if (millis() - lastTelemetryMs >= TELEMETRY_INTERVAL_MS) {
+      lastTelemetryMs += TELEMETRY_INTERVAL_MS;
+      sendStatus();
+  }
 }
 
-void parseBuffer(uint bufferSize) {
-  if ( bufferSize % 2 != 0) {
-      // buffer has bad size so return
-      return;
+// Returns the payload length of a command, or -1 if the code is unknown
+int commandLength(byte code) {
+  switch (code) {
+  case SERIAL_CODE_PLAYER1:
+  case SERIAL_CODE_PLAYER2:
+      return 1;
+
+  case SERIAL_CODE_SLEW_PLAYER1:
+  case SERIAL_CODE_SLEW_PLAYER2:
+      return 2;
+
+  case SERIAL_CODE_RAMP_PLAYER1:
+  case SERIAL_CODE_RAMP_PLAYER2:
+      return 3;
+
+  case SERIAL_CODE_PING:
+      return 4;
+
+  default:
+      return -1;
   }
+}
 
-  for (uint i = 0; i!=bufferSize; i++) {
-      switch (buffer[i]) {
-      case SERIAL_CODE_PLAYER1:
-          car1State = 0xFF * (buffer[++i]/100.00);
-          break;
-      
-      case SERIAL_CODE_PLAYER2:
-          car2State = 0xFF * (buffer[++i]/100.00);
+// Decodes [SYNC][TYPE][LENGTH][PAYLOAD...][CHKSUM] command frames, any frame with
+// an unknown type, wrong length or bad checksum is dropped and counted
+void parseByte(byte data) {
+  switch (parseState) {
+  case PARSE_SYNC:
+      if (data == COMMAND_SYNC) {
+          parseState = PARSE_TYPE;
+      } else {
+          parseErrors++;
+      }
+      break;
+
+  case PARSE_TYPE:
+      command = data;
+      commandSum = data;
+      parseState = PARSE_LENGTH;
+      break;
+
+  case PARSE_LENGTH:
+      if ((int)data != commandLength(command)) {
+          parseErrors++;
+          parseState = PARSE_SYNC;
           break;
+      }
 
-      default:
+      commandBytesNeeded = data;
+      commandBytesReceived = 0;
+      commandSum += data;
+      parseState = PARSE_PAYLOAD;
+      break;
+
+  case PARSE_PAYLOAD:
+      buffer[commandBytesReceived++] = data;
+      commandSum += data;
+      if (commandBytesReceived >= commandBytesNeeded) {
+          parseState = PARSE_CHKSUM;
+      }
+      break;
+
+  case PARSE_CHKSUM:
+      parseState = PARSE_SYNC;
+      if (data != (byte)~commandSum) {
+          parseErrors++;
           break;
       }
+
+      // the time spent receiving the frame is link time, not processing time
+      commandMicros = micros();
+      executeCommand();
+      break;
+
+  default:
+      parseState = PARSE_SYNC;
+      break;
+  }
+}
+
+void executeCommand() {
+  switch (command) {
+  case SERIAL_CODE_PLAYER1:
+      startRamp(car1, speedToPwm(buffer[0]), 0);
+      break;
+
+  case SERIAL_CODE_PLAYER2:
+      startRamp(car2, speedToPwm(buffer[0]), 0);
+      break;
+
+  case SERIAL_CODE_RAMP_PLAYER1:
+      startRamp(car1, speedToPwm(buffer[0]), ((uint)buffer[1] << 8) | buffer[2]);
+      break;
+
+  case SERIAL_CODE_RAMP_PLAYER2:
+      startRamp(car2, speedToPwm(buffer[0]), ((uint)buffer[1] << 8) | buffer[2]);
+      break;
+
+  case SERIAL_CODE_SLEW_PLAYER1:
+      car1.maxSlew = ((uint)buffer[0] << 8) | buffer[1];
+      break;
+
+  case SERIAL_CODE_SLEW_PLAYER2:
+      car2.maxSlew = ((uint)buffer[0] << 8) | buffer[1];
+      break;
+
+  case SERIAL_CODE_PING:
+      sendPong(commandMicros);
+      break;
+
+  default:
+      break;
+  }
+}
+
+// Converts a speed percentage (0-100) to a pwm duty cycle
+byte speedToPwm(byte speed) {
+  if (speed > 100) {
+      parseErrors++;
+      speed = 100;
+  }
+
+  return (0xFF * (uint)speed) / 100;
+}
+
+// Move a lane towards a new pwm target over rampMs, a ramp time of 0 is a step change
+void startRamp(Lane &lane, byte pwm, uint rampMs) {
+  lane.target = (long)pwm << 8;
+
+  uint ticks = rampMs / RAMP_TICK_MS;
+  if (ticks == 0) {
+      lane.ticksRemaining = 0;
+      lane.step = 0;
+      return;
+  }
+
+  // the remainder of the division is carried forward tick by tick (as in Bresenham's line
+  // algorithm) so long ramps advance evenly instead of jumping at the final tick
+  long change = lane.target - lane.current;
+  lane.ticks = ticks;
+  lane.ticksRemaining = ticks;
+  lane.step = change / (long)ticks;
+  lane.remainder = change % (long)ticks;
+  lane.error = 0;
+}
+
+// Advance a lane by one tick and return its pwm output
+byte updateLane(Lane &lane) {
+  long delta;
+  if (lane.ticksRemaining > 1) {
+      lane.ticksRemaining--;
+      delta = lane.step;
+
+      lane.error += lane.remainder;
+      if (lane.error >= (long)lane.ticks) {
+          lane.error -= lane.ticks;
+          delta++;
+      } else if (lane.error <= -(long)lane.ticks) {
+          lane.error += lane.ticks;
+          delta--;
+      }
+  } else {
+      // final tick of a ramp (or a step change) lands exactly on the target
+      lane.ticksRemaining = 0;
+      delta = lane.target - lane.current;
   }
-}
\ No newline at end of file
+
+  if (lane.maxSlew > 0) {
+      if (delta > lane.maxSlew) {
+          delta = lane.maxSlew;
+      } else if (delta < -lane.maxSlew) {
+          delta = -lane.maxSlew;
+      }
+  }
+
+  lane.current += delta;
+  return (lane.current + 0x80) >> 8;
+}
+
+uint saturate16(unsigned long value) {
+  return value > 0xFFFF ? 0xFFFF : value;
+}
+
+void sendFrame(byte type, const byte *payload, byte length) {
+  byte chksum = type + length;
+  for (byte i = 0; i != length; i++) {
+      chksum += payload[i];
+  }
+
+  Serial.write(TELEMETRY_SYNC);
+  Serial.write(type);
+  Serial.write(length);
+  Serial.write(payload, length);
+  Serial.write((byte)~chksum);
+}
+
+void sendStatus() {
+  uint loopAvg = saturate16(loopCount ? loopPeriodSum / loopCount : 0);
+  uint loopMax = saturate16(loopPeriodMax);
+
+  byte payload[10];
+  payload[0] = loopAvg >> 8;
+  payload[1] = loopAvg & 0xFF;
+  payload[2] = loopMax >> 8;
+  payload[3] = loopMax & 0xFF;
+  payload[4] = car1State;
+  payload[5] = car2State;
+  payload[6] = rxOverruns >> 8;
+  payload[7] = rxOverruns & 0xFF;
+  payload[8] = parseErrors >> 8;
+  payload[9] = parseErrors & 0xFF;
+
+  sendFrame(TELEMETRY_TYPE_STATUS, payload, sizeof(payload));
+
+  loopPeriodSum = 0;
+  loopPeriodMax = 0;
+  loopCount     = 0;
+}
+
+// Echoes a ping token along with the time since the ping's type byte was read
+void sendPong(unsigned long receivedMicros) {
+  byte payload[6];
+  payload[0] = buffer[0];
+  payload[1] = buffer[1];
+  payload[2] = buffer[2];
+  payload[3] = buffer[3];
+
+  uint turnaround = saturate16(micros() - receivedMicros);
+  payload[4] = turnaround >> 8;
+  payload[5] = turnaround & 0xFF;
+
+  sendFrame(TELEMETRY_TYPE_PONG, payload, sizeof(payload));
+}
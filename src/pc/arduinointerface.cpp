@@ -1,20 +1,37 @@
 #include "./arduinointerface.h"
 
+#include "./monotonicclock.h"
+
 ArduinoInterface::ArduinoInterface(QObject *parent)
-    : QObject(parent) {
-    connect(&serialPort, SIGNAL(readyRead()), this, SLOT(read()));
+    : QObject(parent), m_link("Arduino") {
+    setupLink();
 }
 
 ArduinoInterface::ArduinoInterface(QString portName, QObject *parent)
-    : QObject(parent) {
-
-    connect(&serialPort, SIGNAL(readyRead()), this, SLOT(read()));
-
+    : QObject(parent), m_link("Arduino") {
+    setupLink();
     init(portName);
 }
 
 ArduinoInterface::~ArduinoInterface() {
-    serialPort.close();
+    m_pingTimer.stop();
+}
+
+void ArduinoInterface::setupLink() {
+    connect(&m_link, SIGNAL(dataReceived(QByteArray,qint64)), this, SLOT(read(QByteArray,qint64)));
+    connect(&m_link, SIGNAL(openFailed()), this, SIGNAL(serialConnectionFailed()));
+    connect(&m_link, SIGNAL(connectedChanged(bool)), this, SLOT(handleConnectedChanged(bool)));
+    connect(&m_link, SIGNAL(connectionLost()), this, SIGNAL(connectionLost()));
+    connect(&m_link, SIGNAL(reconnected()), this, SLOT(handleReconnected()));
+
+    // opening the port resets the board, so only a valid telemetry frame shows it is running
+    m_link.setAliveOnData(false);
+    m_link.setSilenceTimeout(ARDUINO_SILENCE_TIMEOUT);
+    m_link.setBootTimeout(ARDUINO_BOOT_TIMEOUT);
+
+    connect(&m_pingTimer, SIGNAL(timeout()), this, SLOT(ping()));
+
+    m_pingTimer.setInterval(500);
 }
 
 //! \brief A More C-Friendly way of enabling serial communications
@@ -22,28 +39,28 @@ int ArduinoInterface::init(const QString portName) {
     qDebug() << "Initializing Arduino Port...";
 
     m_portName = portName;
+    m_frameState = ARDUINO_STATE_SYNC;
 
-    // Set Port Information
     // if using attention or meditation a BaudRate of 9600 is more than enough
     // it may require increasing if additional signal processing is used.
-    serialPort.setPortName(m_portName);
-    serialPort.setBaudRate(QSerialPort::Baud9600);
-
-    if (!serialPort.open(QIODevice::ReadWrite)) {
+    if (m_link.open(m_portName, QSerialPort::Baud9600)) {
         qDebug() << "Failed to Open Serial Port";
-        emit serialConnectionFailed();
         return 1;
     }
 
+    // start measuring the round trip time to the arduino
+    if (m_pingTimer.interval() > 0) {
+        m_pingTimer.start();
+    }
+
     // reset car accel values to 0
     qDebug() << "Resetting arduino...";
-    QByteArray resetData;
-    resetData.reserve(4);
-    resetData[0] = 0x10;
-    resetData[1] = 0x00;
-    resetData[2] = 0x20;
-    resetData[3] = 0x00;
-    write(resetData);
+    setCarSpeed(1, 0);
+    setCarSpeed(2, 0);
+
+    // opening the port may reset the board, dropping anything sent while it boots, so send the
+    // slew limits and speeds again once it reports its first status
+    m_restorePending = true;
 
     qDebug() << "Arduino Ready.";
     emit serialConnectionSuccess();
@@ -51,35 +68,358 @@ int ArduinoInterface::init(const QString portName) {
     return 0;
 }
 
+//! \brief Set the speed of a car, player is 1 or 2 and speed between 0 and 100
+//!
+//! The last speed of each car is remembered and restored after a reconnect.
+//!
+void ArduinoInterface::setCarSpeed(int player, uint8_t speed) {
+    if (player != 1 && player != 2) {
+        qDebug() << "Invalid player: " << player;
+        return;
+    }
+
+    m_carSpeed[player-1] = speed;
+
+    if (!m_link.isConnected()) {
+        return;  // restored once the connection recovers
+    }
+
+    uchar payload[1];
+    payload[0] = speed;
+    writeCommand(player == 1 ? ARDUINO_CODE_PLAYER1 : ARDUINO_CODE_PLAYER2, payload, sizeof(payload));
+}
+
+//! \brief Ramp the speed of a car to a target over rampTime milliseconds
+//!
+//! The arduino interpolates the pwm output itself, so a single command gives a smooth change
+//! in speed instead of frequent updates from the PC.
+//!
+void ArduinoInterface::rampCarSpeed(int player, uint8_t speed, uint16_t rampTime) {
+    if (player != 1 && player != 2) {
+        qDebug() << "Invalid player: " << player;
+        return;
+    }
+
+    m_carSpeed[player-1] = speed;
+
+    if (!m_link.isConnected()) {
+        return;  // restored once the connection recovers
+    }
+
+    uchar payload[3];
+    payload[0] = speed;
+    payload[1] = (rampTime>>8) & 0xFF;
+    payload[2] = rampTime & 0xFF;
+    writeCommand(player == 1 ? ARDUINO_CODE_RAMP_PLAYER1 : ARDUINO_CODE_RAMP_PLAYER2, payload, sizeof(payload));
+}
+
+//! \brief Limit how quickly the arduino may change the speed of a car, 0 removes the limit
+//!
+//! The limit applies to both step and ramped speed changes.
+//!
+void ArduinoInterface::setMaxSlew(int player, uint16_t percentPerSecond) {
+    if (player != 1 && player != 2) {
+        qDebug() << "Invalid player: " << player;
+        return;
+    }
+
+    // convert to pwm change per tick in 8.8 fixed point
+    uint64_t slew = (static_cast<uint64_t>(percentPerSecond) * 255 * 256 * ARDUINO_RAMP_TICK) / (100 * 1000);
+    if (percentPerSecond != 0 && slew == 0) {
+        slew = 1;
+    }
+    m_maxSlew[player-1] = static_cast<uint16_t>(qMin<uint64_t>(slew, 0xFFFF));
+
+    if (!m_link.isConnected()) {
+        return;  // restored once the connection recovers
+    }
+
+    writeSlew(player);
+}
+
+bool ArduinoInterface::isConnected() const {
+    return m_link.isConnected();
+}
+
+bool ArduinoInterface::getAutoReconnect() const {
+    return m_link.getAutoReconnect();
+}
+
+//! \brief Enable or disable reconnecting in the background after a port error or silence
+void ArduinoInterface::setAutoReconnect(bool enabled) {
+    m_link.setAutoReconnect(enabled);
+}
+
+int ArduinoInterface::getSilenceTimeout() const {
+    return m_link.getSilenceTimeout();
+}
+
+//! \brief Set how long the arduino may go without sending telemetry (in ms) before it is treated as disconnected
+void ArduinoInterface::setSilenceTimeout(int msec) {
+    m_link.setSilenceTimeout(msec);
+}
+
+void ArduinoInterface::handleConnectedChanged(bool connected) {
+    if (connected) {
+        m_frameState = ARDUINO_STATE_SYNC;
+        if (m_pingTimer.interval() > 0) {
+            m_pingTimer.start();
+        }
+    } else {
+        m_pingTimer.stop();
+    }
+
+    emit connectedChanged(connected);
+}
+
+//! \brief Restore the car speeds once the reopened board is running
+//!
+//! Opening the port may have reset the board, so the speeds are sent with the first status
+//! frame rather than straight away.
+//!
+void ArduinoInterface::handleReconnected() {
+    qDebug() << "Arduino reconnected on" << m_portName;
+    m_restorePending = true;
+    emit reconnected();
+}
+
+void ArduinoInterface::writeSlew(int player) {
+    uchar payload[2];
+    payload[0] = (m_maxSlew[player-1]>>8) & 0xFF;
+    payload[1] = m_maxSlew[player-1] & 0xFF;
+    writeCommand(player == 1 ? ARDUINO_CODE_SLEW_PLAYER1 : ARDUINO_CODE_SLEW_PLAYER2, payload, sizeof(payload));
+}
+
+void ArduinoInterface::restoreCarSpeeds() {
+    m_restorePending = false;
+
+    writeSlew(1);
+    writeSlew(2);
+
+    setCarSpeed(1, m_carSpeed[0]);
+    setCarSpeed(2, m_carSpeed[1]);
+}
+
 QString ArduinoInterface::getPortName() const {
     return m_portName;
 }
 
-//! \brief Read any incoming serial communications (I.E. debug messages) from the arduino
-void ArduinoInterface::read() {
-    QByteArray data = serialPort.readAll();
-
-    qDebug() << data;
+//! \brief Round trip time in milliseconds of the most recent ping
+double ArduinoInterface::getRoundTripTime() const {
+    return m_roundTripTime;
 }
 
-//! \brief Write data via the serial port to the arduino controller
+//! \brief Time in milliseconds the most recent ping spent being processed on the arduino
 //!
-//! Values for car speed should be between 0 and 100 and represent the duty cycle ratio of the
-//! pwm controlling the motor.
+//! This is measured from when the arduino read the ping's type byte to when it queued the
+//! pong, so it includes the rest of the ping arriving at 9600 baud and any delay in the
+//! arduino's loop. Subtracting it from the round trip time leaves the time spent getting the
+//! start of the ping to the arduino and the pong back to the PC.
 //!
-void ArduinoInterface::write(const QByteArray &data) {
-    uint64_t bytesWritten = serialPort.write(data);
+double ArduinoInterface::getMcuProcessingTime() const {
+    return m_mcuProcessingTime;
+}
+
+QVariantMap ArduinoInterface::getTelemetry() {
+    convertTelemetryToVariant();
+    return m_telemetryMap;
+}
 
-    if (bytesWritten == -1) {
-        qDebug() << "Failed to write the data to port";
+int ArduinoInterface::getPingInterval() const {
+    return m_pingTimer.interval();
+}
+
+//! \brief Set the interval between round trip time probes. An interval of 0 disables probing
+void ArduinoInterface::setPingInterval(int msec) {
+    if (msec <= 0) {
+        m_pingTimer.stop();
+        m_pingTimer.setInterval(0);
         return;
-    } else if (bytesWritten != data.size()) {
-        qDebug() << "Failed to write all the data to port";
+    }
+
+    m_pingTimer.setInterval(msec);
+    if (m_link.isConnected()) {
+        m_pingTimer.start();
+    }
+}
+
+//! \brief Send a timestamped ping frame, the arduino echoes the token back in a pong frame
+void ArduinoInterface::ping() {
+    if (!m_link.isConnected()) {
         return;
-    } else if (!serialPort.waitForBytesWritten(5000)) {
-        qDebug() << "Operation timed out or an error occurred for port";
+    }
+
+    // token is the low 32 bits of the shared clock in microseconds
+    quint32 token = static_cast<quint32>(monotonicMicros());
+
+    uchar payload[4];
+    payload[0] = (token>>24) & 0xFF;
+    payload[1] = (token>>16) & 0xFF;
+    payload[2] = (token>>8)  & 0xFF;
+    payload[3] = token & 0xFF;
+    writeCommand(ARDUINO_CODE_PING, payload, sizeof(payload));
+}
+
+//! \brief Decode incoming telemetry frames from the arduino, arrival being when the link read them
+void ArduinoInterface::read(const QByteArray &data, qint64 arrival) {
+    m_arrival = arrival;
+
+    for (auto &x : data) {
+        parseByte(x);
+    }
+}
+
+//! \brief Write a command via the serial port to the arduino controller
+//!
+//! The first byte is the command code and the rest its payload, which is framed before it is
+//! sent. Values for car speed should be between 0 and 100 and represent the duty cycle ratio
+//! of the pwm controlling the motor.
+//!
+void ArduinoInterface::write(const QByteArray &data) {
+    if (data.isEmpty()) {
         return;
     }
 
-    return; // write successful
+    writeCommand(static_cast<uchar>(data.at(0)),
+                 reinterpret_cast<const uchar*>(data.constData()) + 1, data.size() - 1);
+}
+
+//! \brief Frame a command as [SYNC][TYPE][LENGTH][PAYLOAD...][CHKSUM] and write it
+//!
+//! CHKSUM is the inverted sum of TYPE, LENGTH and PAYLOAD, matching the telemetry frames, so
+//! the arduino can discard any command corrupted or cut short on the link.
+//!
+void ArduinoInterface::writeCommand(uchar type, const uchar *payload, int length) {
+    if (length > ARDUINO_COMMAND_MAX_LENGTH) {
+        qDebug() << "Arduino command payload too large: " << length;
+        return;
+    }
+
+    char frame[ARDUINO_COMMAND_MAX_LENGTH + 4];
+    uchar chksum = static_cast<uchar>(type + length);
+
+    frame[0] = static_cast<char>(ARDUINO_COMMAND_SYNC);
+    frame[1] = static_cast<char>(type);
+    frame[2] = static_cast<char>(length);
+    for (int i = 0; i != length; i++) {
+        frame[3 + i] = static_cast<char>(payload[i]);
+        chksum = static_cast<uchar>(chksum + payload[i]);
+    }
+    frame[3 + length] = static_cast<char>(~chksum);
+
+    write(frame, length + 4);
+}
+
+//! \brief Write a framed command from a fixed buffer, avoiding a QByteArray allocation per command
+//!
+//! The command is queued on the serial link and never blocks waiting for the port.
+//!
+void ArduinoInterface::write(const char *data, int length) {
+    m_link.write(data, length);
+}
+
+void ArduinoInterface::parseByte(uchar byte) {
+    switch (m_frameState) {
+    /* Waiting for SyncByte */
+    case ARDUINO_STATE_SYNC:
+        if (byte == ARDUINO_TELEMETRY_SYNC) {
+            m_frameState = ARDUINO_STATE_TYPE;
+        }
+        break;
+
+    /* Waiting for frame type */
+    case ARDUINO_STATE_TYPE:
+        m_frameType = byte;
+        m_frameSum  = byte;
+        m_frameState = ARDUINO_STATE_LENGTH;
+        break;
+
+    /* Waiting for Payload[] length */
+    case ARDUINO_STATE_LENGTH:
+        m_frameLength = byte;
+        m_frameBytesReceived = 0;
+        m_frameSum = static_cast<uchar>(m_frameSum + byte);
+        m_frameState = (m_frameLength == 0) ? ARDUINO_STATE_CHKSUM : ARDUINO_STATE_PAYLOAD;
+        break;
+
+    /* Waiting for Payload[] bytes */
+    case ARDUINO_STATE_PAYLOAD:
+        m_framePayload[m_frameBytesReceived++] = byte;
+        m_frameSum = static_cast<uchar>(m_frameSum + byte);
+        if (m_frameBytesReceived >= m_frameLength) {
+            m_frameState = ARDUINO_STATE_CHKSUM;
+        }
+        break;
+
+    /* Waiting for CKSUM byte */
+    case ARDUINO_STATE_CHKSUM:
+        m_frameState = ARDUINO_STATE_SYNC;
+        if (byte != ((~m_frameSum)&0xFF)) {
+            qDebug() << "Arduino telemetry checksum mismatch";
+        } else {
+            parseFrame();
+        }
+        break;
+
+    default:
+        m_frameState = ARDUINO_STATE_SYNC;
+        break;
+    }
+}
+
+void ArduinoInterface::parseFrame() {
+    const uchar *value = m_framePayload;
+
+    // any valid frame shows the arduino is alive
+    m_link.markAlive();
+
+    switch (m_frameType) {
+    case ARDUINO_TELEMETRY_STATUS:
+        if (m_frameLength < 10) {
+            break;
+        }
+
+        m_telemetry.loopPeriodAvg = (value[0]<<8) | value[1];
+        m_telemetry.loopPeriodMax = (value[2]<<8) | value[3];
+        m_telemetry.car1State     = value[4];
+        m_telemetry.car2State     = value[5];
+        m_telemetry.rxOverruns    = (value[6]<<8) | value[7];
+        m_telemetry.parseErrors   = (value[8]<<8) | value[9];
+        convertTelemetryToVariant();
+        emit telemetryChanged(m_telemetryMap);
+
+        if (m_restorePending) {
+            restoreCarSpeeds();
+        }
+        break;
+
+    case ARDUINO_TELEMETRY_PONG: {
+        if (m_frameLength < 6) {
+            break;
+        }
+
+        // timed to when the link read the pong, so waiting in the event loop is not counted
+        quint32 now   = static_cast<quint32>(m_arrival);
+        quint32 token = (static_cast<quint32>(value[0])<<24) | (value[1]<<16) | (value[2]<<8) | value[3];
+
+        // unsigned subtraction handles the token wrapping around
+        m_roundTripTime     = static_cast<quint32>(now - token) / 1000.0;
+        m_mcuProcessingTime = ((value[4]<<8) | value[5]) / 1000.0;
+        emit roundTripTimeChanged(m_roundTripTime);
+        break;
+    }
+
+    default:
+        qDebug() << "Unrecognized Arduino telemetry frame: " << m_frameType;
+        break;
+    }
+}
+
+void ArduinoInterface::convertTelemetryToVariant() {
+    m_telemetryMap["loopPeriodAvg"] = static_cast<int>(m_telemetry.loopPeriodAvg);
+    m_telemetryMap["loopPeriodMax"] = static_cast<int>(m_telemetry.loopPeriodMax);
+    m_telemetryMap["car1State"]     = static_cast<int>(m_telemetry.car1State);
+    m_telemetryMap["car2State"]     = static_cast<int>(m_telemetry.car2State);
+    m_telemetryMap["rxOverruns"]    = static_cast<int>(m_telemetry.rxOverruns);
+    m_telemetryMap["parseErrors"]   = static_cast<int>(m_telemetry.parseErrors);
 }
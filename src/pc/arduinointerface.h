@@ -2,15 +2,24 @@
 #define ARDUINOINTERFACE_H
 
 #include <QObject>
-#include <QSerialPort>
+#include <QTimer>
+#include <QVariantMap>
 #include <QDebug>
 
 #include "./defines.h"
+#include "./seriallink.h"
 
 class ArduinoInterface : public QObject {
     Q_OBJECT
 
     Q_PROPERTY(QString portName MEMBER m_portName)
+    Q_PROPERTY(bool connected              READ isConnected          NOTIFY connectedChanged)
+    Q_PROPERTY(bool autoReconnect          READ getAutoReconnect     WRITE setAutoReconnect)
+    Q_PROPERTY(int silenceTimeout          READ getSilenceTimeout    WRITE setSilenceTimeout)
+    Q_PROPERTY(double roundTripTime        READ getRoundTripTime     NOTIFY roundTripTimeChanged)
+    Q_PROPERTY(double mcuProcessingTime    READ getMcuProcessingTime NOTIFY roundTripTimeChanged)
+    Q_PROPERTY(QVariantMap telemetry       READ getTelemetry         NOTIFY telemetryChanged)
+    Q_PROPERTY(int pingInterval            READ getPingInterval      WRITE setPingInterval)
  public:
     explicit ArduinoInterface(QObject *parent = nullptr);
     explicit ArduinoInterface(QString portName, QObject *parent = nullptr);
@@ -20,17 +29,77 @@ class ArduinoInterface : public QObject {
 
     QString getPortName() const;
 
+    bool isConnected() const;
+    bool getAutoReconnect() const;
+    void setAutoReconnect(bool enabled);
+    int  getSilenceTimeout() const;
+    void setSilenceTimeout(int msec);
+
+    double getRoundTripTime() const;
+    double getMcuProcessingTime() const;
+    QVariantMap getTelemetry();
+    int getPingInterval() const;
+
  signals:
     void serialConnectionSuccess();  //! \brief Indicates a successful serial port connection
     void serialConnectionFailed();   //! \brief Induciates a failed serial port connection
 
+    void connectedChanged(bool connected);  //! \brief Indicates the connection state has changed
+    void connectionLost();                  //! \brief Indicates a port error or silence, a reconnect will be attempted
+    void reconnected();                     //! \brief Indicates the connection was recovered after being lost
+
+    void roundTripTimeChanged(double rtt);     //! \brief Indicates a new PC to Arduino round trip time (ms)
+    void telemetryChanged(QVariantMap data);   //! \brief Indicates a new telemetry report from the Arduino
+
  public slots:
-    void read();
+    void read(const QByteArray &data, qint64 arrival);
     void write(const QByteArray &data);
+    void setCarSpeed(int player, uint8_t speed);
+    void rampCarSpeed(int player, uint8_t speed, uint16_t rampTime);
+    void setMaxSlew(int player, uint16_t percentPerSecond);
+
+    void ping();
+    void setPingInterval(int msec);
+
+ private slots:
+    void handleConnectedChanged(bool connected);
+    void handleReconnected();
 
  private:
     QString m_portName;
-    QSerialPort serialPort;
+    SerialLink m_link;
+
+    QTimer m_pingTimer;
+
+    bool m_restorePending  = false;
+
+    uint8_t  m_carSpeed[2] = {0, 0};  // last requested speed of each car
+    uint16_t m_maxSlew[2]  = {0, 0};  // slew limit of each car in the arduino's units
+
+    void setupLink();
+    void writeCommand(uchar type, const uchar *payload, int length);
+    void writeSlew(int player);
+    void write(const char *data, int length);
+    void restoreCarSpeeds();
+
+    double m_roundTripTime     = 0.0;
+    double m_mcuProcessingTime = 0.0;
+
+    arduinoTelemetry_t m_telemetry;
+    QVariantMap m_telemetryMap;
+    void convertTelemetryToVariant();
+
+    // telemetry frame decoder state
+    uchar m_frameState         = ARDUINO_STATE_SYNC;
+    uchar m_frameType          = 0;
+    uchar m_frameLength        = 0;
+    uchar m_frameBytesReceived = 0;
+    uchar m_frameSum           = 0;
+    uchar m_framePayload[256];
+    qint64 m_arrival = 0;  // when the data being decoded was read from the port
+
+    void parseByte(uchar byte);
+    void parseFrame();
 };
 
 #endif  // ARDUINOINTERFACE_H
@@ -24,9 +24,22 @@ TEMPLATE = app
 SOURCES += \
         main.cpp \
         mindwavecontroller.cpp \
-        arduinointerface.cpp
+        arduinointerface.cpp \
+        seriallink.cpp \
+        channelhistory.cpp \
+        controlmapping.cpp \
+        thinkgearstreamparser.cpp \
+        blinkdetector.cpp \
+        jitterbuffer.cpp
 
 HEADERS += \
         mindwavecontroller.h \
         arduinointerface.h \
+        seriallink.h \
+        channelhistory.h \
+        controlmapping.h \
+        thinkgearstreamparser.h \
+        blinkdetector.h \
+        jitterbuffer.h \
+        monotonicclock.h \
         defines.h
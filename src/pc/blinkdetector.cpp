@@ -0,0 +1,129 @@
+#include "./blinkdetector.h"
+
+BlinkDetector::BlinkDetector() {
+    reset();
+}
+
+void BlinkDetector::setConfig(const Config &config) {
+    m_config = config;
+
+    if (m_config.slopeSpan < 1) {
+        m_config.slopeSpan = 1;
+    } else if (m_config.slopeSpan >= historySize) {
+        m_config.slopeSpan = historySize - 1;
+    }
+
+    reset();
+}
+
+const BlinkDetector::Config &BlinkDetector::getConfig() const {
+    return m_config;
+}
+
+//! \brief Forget the baseline and any event in progress, e.g. after a reconnect
+void BlinkDetector::reset() {
+    m_state    = StateIdle;
+    m_baseline = 0;
+    m_primed   = false;
+
+    for (int i = 0; i != historySize; i++) {
+        m_history[i] = 0;
+    }
+    m_historyIndex = 0;
+
+    m_peak     = 0;
+    m_duration = 0;
+    m_reported = false;
+    m_refractoryRemaining = 0;
+}
+
+//! \brief Strength (peak deviation from baseline) of the most recent blink or artifact
+uint16_t BlinkDetector::getStrength() const {
+    return m_strength;
+}
+
+//! \brief Process one raw sample, returning any event it completes
+BlinkDetector::Event BlinkDetector::process(int16_t sample) {
+    if (!m_primed) {
+        m_baseline = static_cast<int32_t>(sample) << m_config.baselineShift;
+        for (int i = 0; i != historySize; i++) {
+            m_history[i] = sample;
+        }
+        m_primed = true;
+    }
+
+    int previous = m_history[(m_historyIndex + historySize - m_config.slopeSpan) % historySize];
+    m_history[m_historyIndex] = sample;
+    m_historyIndex = (m_historyIndex + 1) % historySize;
+
+    int deviation = sample - (m_baseline >> m_config.baselineShift);
+    int slope     = sample - previous;
+    int magnitude = deviation < 0 ? -deviation : deviation;
+
+    Event event = NoEvent;
+
+    // the sample ending the refractory period may already start a new event
+    if (m_state == StateRefractory && --m_refractoryRemaining <= 0) {
+        m_state = StateIdle;
+    }
+
+    switch (m_state) {
+    case StateRefractory:
+        break;
+
+    case StateIdle:
+        if (magnitude > m_config.highThreshold &&
+                (slope > m_config.slopeThreshold || slope < -m_config.slopeThreshold)) {
+            m_state    = StateEvent;
+            m_polarity = deviation < 0 ? -1 : 1;
+            m_peak     = magnitude;
+            m_duration = 0;
+            m_reported = false;
+        }
+        break;
+
+    case StateEvent: {
+        m_duration++;
+        int value = deviation * m_polarity;
+        if (value > m_peak) {
+            m_peak = value;
+        }
+
+        if (!m_reported) {
+            if (sample >= m_config.saturation || sample <= -m_config.saturation ||
+                    m_duration > m_config.maxDuration) {
+                event = ArtifactEvent;
+                m_reported = true;
+            } else if (m_duration >= m_config.minDuration && value * 4 < m_peak * 3) {
+                // past the peak, report the blink without waiting for the signal to settle
+                event = BlinkEvent;
+                m_reported = true;
+            }
+
+            if (event != NoEvent) {
+                m_strength = m_peak > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(m_peak);
+            }
+        }
+
+        if (event == ArtifactEvent || m_duration > m_config.maxDuration) {
+            // the signal may have shifted (electrode movement) and never return to the old
+            // baseline, even after a blink was reported, so restart the baseline from here
+            // rather than waiting for it to settle
+            m_baseline = static_cast<int32_t>(sample) << m_config.baselineShift;
+            m_state = StateRefractory;
+            m_refractoryRemaining = m_config.refractory;
+        } else if (value < m_config.lowThreshold) {
+            m_state = StateRefractory;
+            m_refractoryRemaining = m_config.refractory;
+        }
+        break;
+    }
+    }
+
+    // only track the baseline outside of events so blinks do not drag it
+    if (m_state != StateEvent) {
+        m_baseline += sample - (m_baseline >> m_config.baselineShift);
+    }
+
+    return event;
+}
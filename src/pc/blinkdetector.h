@@ -0,0 +1,79 @@
+#ifndef BLINKDETECTOR_H
+#define BLINKDETECTOR_H
+
+#include <cstdint>
+
+//! \title BlinkDetector
+//!
+//! \brief Streaming eye blink and artifact detector for the 512Hz raw signal.
+//!
+//! Each sample is compared against a slowly tracking baseline. An event starts when the
+//! deviation and the slope over a few samples both exceed their thresholds, and a blink is
+//! reported as soon as the deviation has fallen back a quarter of the way from its peak, so
+//! it is known tens of milliseconds after the peak rather than after the eSense update.
+//! Events reaching the ADC limit, or lasting too long before a blink was seen, are reported
+//! as artifacts instead. An event still running at the maximum duration, reported or not, is
+//! ended and the baseline restarts from the current sample, so a shift in the signal cannot
+//! hold the detector in an event. Otherwise the event ends once the deviation drops below a
+//! lower threshold (hysteresis). Either way further events are ignored for a refractory
+//! period. Processing a sample is O(1) integer arithmetic.
+//!
+class BlinkDetector {
+ public:
+    enum Event {
+        NoEvent = 0,
+        BlinkEvent,
+        ArtifactEvent
+    };
+
+    //! \brief Thresholds in raw ADC units, durations in samples (512 per second)
+    struct Config {
+        int highThreshold    = 400;  // deviation starting an event
+        int lowThreshold     = 150;  // deviation ending an event
+        int slopeThreshold   = 60;   // change over slopeSpan samples starting an event
+        int slopeSpan        = 4;
+        int minDuration      = 10;   // ~20ms, shorter spikes are ignored
+        int maxDuration      = 205;  // ~400ms, longer events are artifacts
+        int refractory       = 128;  // ~250ms
+        int saturation       = 2000; // |sample| at which the ADC is considered clipped
+        int baselineShift    = 8;    // baseline time constant of 2^shift samples
+    };
+
+    BlinkDetector();
+
+    void setConfig(const Config &config);
+    const Config &getConfig() const;
+
+    Event process(int16_t sample);
+    void reset();
+
+    uint16_t getStrength() const;
+
+ private:
+    enum State {
+        StateIdle,
+        StateEvent,
+        StateRefractory
+    };
+
+    static const int historySize = 16;  // must exceed slopeSpan
+
+    Config m_config;
+
+    State   m_state     = StateIdle;
+    int32_t m_baseline  = 0;  // baseline << baselineShift
+    bool    m_primed    = false;
+
+    int16_t m_history[historySize];
+    int     m_historyIndex = 0;
+
+    int  m_polarity = 1;
+    int  m_peak     = 0;
+    int  m_duration = 0;
+    int  m_refractoryRemaining = 0;
+    bool m_reported = false;
+
+    uint16_t m_strength = 0;
+};
+
+#endif  // BLINKDETECTOR_H
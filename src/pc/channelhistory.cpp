@@ -0,0 +1,230 @@
+#include "./channelhistory.h"
+
+ChannelHistory::ChannelHistory(size_t capacity) {
+    setCapacity(capacity);
+}
+
+//! \brief Reallocate the sample buffer. This clears the history and removes all windows.
+void ChannelHistory::setCapacity(size_t capacity) {
+    if (capacity == 0) {
+        capacity = 1;
+    }
+
+    m_samples.assign(capacity, 0.0);
+    m_windows.clear();
+    m_size = 0;
+    m_seq  = 0;
+}
+
+size_t ChannelHistory::capacity() const {
+    return m_samples.size();
+}
+
+//! \brief Number of samples currently held, at most capacity()
+size_t ChannelHistory::size() const {
+    return m_size;
+}
+
+//! \brief Number of samples pushed since the history was last cleared
+uint64_t ChannelHistory::totalSamples() const {
+    return m_seq;
+}
+
+//! \brief Register a window over the most recent \a length samples
+//!
+//! Windows of the same length are shared, so several consumers asking for the same window
+//! get the same index. Returns -1 if the length is zero or larger than the capacity.
+//!
+int ChannelHistory::addWindow(size_t length) {
+    if (length == 0 || length > m_samples.size()) {
+        return -1;
+    }
+
+    for (size_t i = 0; i != m_windows.size(); i++) {
+        if (m_windows[i].length == length) {
+            return static_cast<int>(i);
+        }
+    }
+
+    Window window;
+    window.length = length;
+    window.minQueue.seq.assign(length, 0);
+    window.maxQueue.seq.assign(length, 0);
+
+    // seed the new window with the samples already held
+    uint64_t first = m_seq - (m_size < length ? m_size : length);
+    m_windows.push_back(window);
+    Window &w = m_windows.back();
+    for (uint64_t seq = first; seq != m_seq; seq++) {
+        double x = sampleAt(seq);
+        w.count++;
+        w.sum += x;
+        double delta = x - w.mean;
+        w.mean += delta / w.count;
+        w.m2   += delta * (x - w.mean);
+    }
+
+    // rebuild the min/max queues by replaying the seeded samples
+    uint64_t next = m_seq;
+    for (m_seq = first; m_seq != next; m_seq++) {
+        updateQueue(w.minQueue, length, true);
+        updateQueue(w.maxQueue, length, false);
+    }
+
+    return static_cast<int>(m_windows.size() - 1);
+}
+
+int ChannelHistory::windowCount() const {
+    return static_cast<int>(m_windows.size());
+}
+
+void ChannelHistory::push(double value) {
+    for (auto &w : m_windows) {
+        if (w.count < w.length) {
+            w.count++;
+            w.sum += value;
+
+            double delta = value - w.mean;
+            w.mean += delta / w.count;
+            w.m2   += delta * (value - w.mean);
+        } else {
+            // slide the window, the outgoing sample is still in the ring at this point
+            double old     = sampleAt(m_seq - w.length);
+            double oldMean = w.mean;
+
+            w.sum  += value - old;
+            w.mean += (value - old) / w.length;
+            w.m2   += (value - old) * (value - w.mean + old - oldMean);
+            if (w.m2 < 0.0) {
+                w.m2 = 0.0;
+            }
+        }
+    }
+
+    m_samples[m_seq % m_samples.size()] = value;
+    if (m_size < m_samples.size()) {
+        m_size++;
+    }
+
+    for (auto &w : m_windows) {
+        updateQueue(w.minQueue, w.length, true);
+        updateQueue(w.maxQueue, w.length, false);
+    }
+
+    m_seq++;
+}
+
+//! \brief Discard all samples, registered windows are kept
+void ChannelHistory::clear() {
+    m_size = 0;
+    m_seq  = 0;
+
+    for (auto &w : m_windows) {
+        w.count = 0;
+        w.sum   = 0.0;
+        w.mean  = 0.0;
+        w.m2    = 0.0;
+        w.minQueue.head  = 0;
+        w.minQueue.count = 0;
+        w.maxQueue.head  = 0;
+        w.maxQueue.count = 0;
+    }
+}
+
+double ChannelHistory::latest() const {
+    return at(0);
+}
+
+//! \brief Retrieve a previous sample, 0 being the most recent. Returns 0 if out of range.
+double ChannelHistory::at(size_t samplesAgo) const {
+    if (samplesAgo >= m_size) {
+        return 0.0;
+    }
+
+    return sampleAt(m_seq - 1 - samplesAgo);
+}
+
+//! \brief Window queries return 0 for an invalid windowIndex, including the -1 returned when
+//!        addWindow() fails
+size_t ChannelHistory::windowLength(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    return w ? w->length : 0;
+}
+
+//! \brief Number of samples currently in the window, at most windowLength()
+size_t ChannelHistory::count(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    return w ? w->count : 0;
+}
+
+double ChannelHistory::sum(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    return w ? w->sum : 0.0;
+}
+
+double ChannelHistory::mean(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    return w ? w->mean : 0.0;
+}
+
+//! \brief Sample variance of the window, 0 if it holds fewer than two samples
+double ChannelHistory::variance(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    if (!w || w->count < 2) {
+        return 0.0;
+    }
+
+    return w->m2 / (w->count - 1);
+}
+
+double ChannelHistory::min(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    if (!w || w->minQueue.count == 0) {
+        return 0.0;
+    }
+
+    return sampleAt(w->minQueue.seq[w->minQueue.head]);
+}
+
+double ChannelHistory::max(int windowIndex) const {
+    const Window *w = window(windowIndex);
+    if (!w || w->maxQueue.count == 0) {
+        return 0.0;
+    }
+
+    return sampleAt(w->maxQueue.seq[w->maxQueue.head]);
+}
+
+const ChannelHistory::Window *ChannelHistory::window(int windowIndex) const {
+    if (windowIndex < 0 || windowIndex >= static_cast<int>(m_windows.size())) {
+        return nullptr;
+    }
+
+    return &m_windows[windowIndex];
+}
+
+double ChannelHistory::sampleAt(uint64_t seq) const {
+    return m_samples[seq % m_samples.size()];
+}
+
+//! \brief Add the sample at m_seq to a monotonic queue and expire samples outside the window
+void ChannelHistory::updateQueue(MonotonicQueue &queue, size_t length, bool keepMinimum) {
+    // expire first, the ring slot of an expired sample may already be overwritten
+    while (queue.count && queue.seq[queue.head] + length <= m_seq) {
+        queue.head = (queue.head + 1) % length;
+        queue.count--;
+    }
+
+    double value = sampleAt(m_seq);
+    while (queue.count) {
+        size_t back = (queue.head + queue.count - 1) % length;
+        double backValue = sampleAt(queue.seq[back]);
+        if (keepMinimum ? (backValue < value) : (backValue > value)) {
+            break;
+        }
+        queue.count--;
+    }
+
+    queue.seq[(queue.head + queue.count) % length] = m_seq;
+    queue.count++;
+}
@@ -0,0 +1,74 @@
+#ifndef CHANNELHISTORY_H
+#define CHANNELHISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! \title ChannelHistory
+//!
+//! \brief Fixed capacity history of a single data channel with windowed statistics.
+//!
+//! Samples are stored in a preallocated ring buffer. Any number of windows (each no longer
+//! than the capacity) can be registered, for which the sum, mean, variance, minimum and
+//! maximum of the most recent samples are maintained incrementally. Pushing a sample and
+//! querying a window are O(1) (amortised for min/max) and never allocate; memory is only
+//! allocated by setCapacity() and addWindow().
+//!
+class ChannelHistory {
+ public:
+    explicit ChannelHistory(size_t capacity = 256);
+
+    void setCapacity(size_t capacity);
+    size_t capacity() const;
+    size_t size() const;
+    uint64_t totalSamples() const;
+
+    int addWindow(size_t length);
+    int windowCount() const;
+
+    void push(double value);
+    void clear();
+
+    double latest() const;
+    double at(size_t samplesAgo) const;
+
+    // Window aggregates, windowIndex is the value returned by addWindow(). An invalid index gives 0
+    size_t windowLength(int windowIndex) const;
+    size_t count(int windowIndex) const;
+    double sum(int windowIndex) const;
+    double mean(int windowIndex) const;
+    double variance(int windowIndex) const;
+    double min(int windowIndex) const;
+    double max(int windowIndex) const;
+
+ private:
+    //! \brief Ring of sample sequence numbers kept monotonic for sliding min/max
+    struct MonotonicQueue {
+        std::vector<uint64_t> seq;
+        size_t head  = 0;
+        size_t count = 0;
+    };
+
+    struct Window {
+        size_t length = 0;
+        size_t count  = 0;
+        double sum    = 0.0;
+        double mean   = 0.0;
+        double m2     = 0.0;  // Welford sum of squared differences
+        MonotonicQueue minQueue;
+        MonotonicQueue maxQueue;
+    };
+
+    std::vector<double> m_samples;
+    size_t   m_size = 0;
+    uint64_t m_seq  = 0;  // sequence number of the next sample
+
+    std::vector<Window> m_windows;
+
+    const Window *window(int windowIndex) const;
+    double sampleAt(uint64_t seq) const;
+    void updateQueue(MonotonicQueue &queue, size_t length, bool keepMinimum);
+};
+
+#endif  // CHANNELHISTORY_H
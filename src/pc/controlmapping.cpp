@@ -0,0 +1,385 @@
+#include "./controlmapping.h"
+
+#include <algorithm>
+#include <cmath>
+
+ControlMapping::ControlMapping(QObject *parent) : QObject(parent) {
+    // default mapping is attention straight to speed
+    Stage attention;
+    attention.type  = StageAttention;
+    attention.param = 1.0f;
+    addStage(m_config, attention);
+
+    Stage clamp;
+    clamp.type = StageClamp;
+    addStage(m_config, clamp);
+
+    m_config.usesAttention = true;
+
+    m_blinkTimer.setSingleShot(true);
+    connect(&m_blinkTimer, &QTimer::timeout, this, &ControlMapping::endBoost);
+}
+
+//! \brief Compile the mapping described by a settings group into the stage pipeline
+//!
+//! Returns 0 on success, or non-zero if the configuration is invalid in which case the
+//! previous mapping is left untouched.
+//!
+int ControlMapping::configure(QSettings &settings, const QString &group) {
+    Config config;
+
+    settings.beginGroup(group);
+
+    int result = 0;
+
+    // inputs are summed into the accumulator
+    QStringList inputs = settings.value("inputs", QStringList() << "attention:1.0").toStringList();
+    for (const auto &input : inputs) {
+        if (parseInput(config, input.trimmed())) {
+            result = 1;
+        }
+    }
+
+    Stage clamp;
+    clamp.type = StageClamp;
+    result |= addStage(config, clamp);
+
+    float deadZone = 0.0f;
+    result |= readFloat(settings, group, "deadZone", 0.0f, 0.0f, 0.999f, deadZone);
+    if (deadZone > 0.0f) {
+        Stage stage;
+        stage.type  = StageDeadZone;
+        stage.param = deadZone;
+        result |= addStage(config, stage);
+    }
+
+    QString curve = settings.value("curve", "linear").toString();
+    Stage curveStage;
+    curveStage.type  = StageCurve;
+    if (curve == "linear") {
+        curveStage.curve = CurveLinear;
+    } else if (curve == "quadratic") {
+        curveStage.curve = CurveQuadratic;
+    } else if (curve == "sqrt") {
+        curveStage.curve = CurveSqrt;
+    } else if (curve == "smoothstep") {
+        curveStage.curve = CurveSmoothstep;
+    } else if (curve == "power") {
+        curveStage.curve = CurvePower;
+    } else {
+        qDebug() << "Unknown curve for" << group << ":" << curve;
+        result = 1;
+    }
+
+    result |= readFloat(settings, group, "gamma", 2.0f, 0.01f, 100.0f, curveStage.param);
+
+    if (curveStage.curve != CurveLinear) {
+        result |= addStage(config, curveStage);
+    }
+
+    int maxSpeed, rampTime, blinkBoost, blinkHold, blinkRampTime, maxSlew;
+    result |= readFloat(settings, group, "gain", 1.0f, 0.0f, 100.0f, config.gain);
+    result |= readInt(settings, group, "maxSpeed", 70, 0, 100, maxSpeed);
+    result |= readInt(settings, group, "rampTime", 150, 0, 0xFFFF, rampTime);
+
+    result |= readInt(settings, group, "blinkBoost", 0, -100, 100, blinkBoost);
+    result |= readInt(settings, group, "blinkHold", 500, 0, 60000, blinkHold);
+    result |= readInt(settings, group, "blinkRampTime", 100, 0, 0xFFFF, blinkRampTime);
+
+    result |= readInt(settings, group, "maxSlew", 0, 0, 0xFFFF, maxSlew);
+
+    config.maxSpeed      = maxSpeed;
+    config.rampTime      = rampTime;
+    config.blinkBoost    = blinkBoost;
+    config.blinkHold     = blinkHold;
+    config.blinkRampTime = blinkRampTime;
+    config.maxSlew       = maxSlew;
+
+    settings.endGroup();
+
+    if (result == 0) {
+        m_config = config;
+    }
+
+    return result;
+}
+
+//! \brief Drive a car from a headset, player is 1 or 2
+//!
+//! Only the signals the compiled mapping depends on trigger an update.
+//!
+void ControlMapping::attach(MindWaveController *controller, ArduinoInterface *arduino, int player) {
+    m_controller = controller;
+    m_arduino    = arduino;
+    m_player     = player;
+
+    if (m_config.usesAttention) {
+        connect(controller, &MindWaveController::attentionDataChanged, this, &ControlMapping::update);
+    }
+
+    if (m_config.usesMeditation) {
+        connect(controller, &MindWaveController::meditationDataChanged, this, &ControlMapping::update);
+    }
+
+    if (m_config.usesEegPower) {
+        connect(controller, &MindWaveController::asicEegDataChanged, this, &ControlMapping::update);
+    }
+
+    if (m_config.blinkBoost != 0) {
+        connect(controller, &MindWaveController::blinkDetected, this, &ControlMapping::blink);
+    }
+
+    // stop the car while the headset is reconnecting
+    connect(controller, &MindWaveController::connectionLost, this, &ControlMapping::stop);
+
+    // the arduino keeps the limit and sends it again whenever the board restarts
+    arduino->setMaxSlew(player, m_config.maxSlew);
+}
+
+//! \brief Run the pipeline on the controller's latest values and return the car speed
+uint8_t ControlMapping::evaluate() const {
+    if (!m_controller) {
+        return 0;
+    }
+
+    const asicEegData_t &eeg = m_controller->getAsicEegValues();
+    float acc = 0.0f;
+
+    for (int i = 0; i != m_config.stageCount; i++) {
+        const Stage &stage = m_config.stages[i];
+
+        switch (stage.type) {
+        case StageAttention:
+            acc += m_controller->getAttentionData() / 100.0f * stage.param;
+            break;
+
+        case StageMeditation:
+            acc += m_controller->getMeditationData() / 100.0f * stage.param;
+            break;
+
+        case StageBand: {
+            float total = 0.0f;
+            for (int band = 0; band != 8; band++) {
+                total += bandValue(eeg, band);
+            }
+            if (total > 0.0f) {
+                acc += bandValue(eeg, stage.band) / total * stage.param;
+            }
+            break;
+        }
+
+        case StageBandRatio: {
+            float denominator = bandValue(eeg, stage.band2);
+            if (denominator > 0.0f) {
+                acc += bandValue(eeg, stage.band) / denominator * stage.param;
+            }
+            break;
+        }
+
+        case StageClamp:
+            acc = qBound(0.0f, acc, 1.0f);
+            break;
+
+        case StageDeadZone:
+            acc = (acc <= stage.param) ? 0.0f : (acc - stage.param) / (1.0f - stage.param);
+            break;
+
+        case StageCurve:
+            switch (stage.curve) {
+            case CurveQuadratic:  acc = acc * acc;                      break;
+            case CurveSqrt:       acc = std::sqrt(acc);                 break;
+            case CurveSmoothstep: acc = acc * acc * (3.0f - 2.0f * acc); break;
+            case CurvePower:      acc = std::pow(acc, stage.param);     break;
+            default:                                                    break;
+            }
+            break;
+        }
+    }
+
+    float speed = acc * 100.0f * m_config.gain;
+    if (speed <= 0.0f) {
+        return 0;
+    }
+
+    return speed >= m_config.maxSpeed ? m_config.maxSpeed : static_cast<uint8_t>(speed + 0.5f);
+}
+
+uint8_t ControlMapping::getSpeed() const {
+    return m_speed;
+}
+
+//! \brief Evaluate the mapping and send the speed to the car if it has changed
+void ControlMapping::update() {
+    if (!m_arduino) {
+        return;
+    }
+
+    uint8_t  speed    = evaluate();
+    uint16_t rampTime = m_config.rampTime;
+    if (m_boostActive) {
+        speed    = static_cast<uint8_t>(qBound(0, speed + m_config.blinkBoost, static_cast<int>(m_config.maxSpeed)));
+        rampTime = m_config.blinkRampTime;
+    }
+
+    if (m_speedSent && speed == m_speed) {
+        return;
+    }
+
+    m_speed = speed;
+    m_speedSent = true;
+    m_arduino->rampCarSpeed(m_player, speed, rampTime);
+    emit speedChanged(speed);
+}
+
+//! \brief Apply the blink boost (or brake) for blinkHold milliseconds
+void ControlMapping::blink(uint16_t /* strength */) {
+    if (m_config.blinkBoost == 0) {
+        return;
+    }
+
+    m_boostActive = true;
+    m_blinkTimer.start(m_config.blinkHold);
+    update();
+}
+
+void ControlMapping::endBoost() {
+    m_boostActive = false;
+    update();
+}
+
+//! \brief Stop the car, the next update sends its speed again even if unchanged
+void ControlMapping::stop() {
+    m_blinkTimer.stop();
+    m_boostActive = false;
+
+    m_speed = 0;
+    m_speedSent = false;
+
+    if (m_arduino) {
+        m_arduino->setCarSpeed(m_player, 0);
+    }
+    emit speedChanged(0);
+}
+
+//! \brief Read a float key, returning 1 if it is not a number or outside [min, max]
+int ControlMapping::readFloat(QSettings &settings, const QString &group, const char *key,
+                              float defaultValue, float min, float max, float &value) {
+    bool ok = true;
+    value = settings.contains(key) ? settings.value(key).toFloat(&ok) : defaultValue;
+
+    if (!ok || !(value >= min && value <= max)) {
+        qDebug() << "Invalid" << key << "for" << group << ":" << settings.value(key).toString()
+                 << "(expected" << min << "to" << max << ")";
+        value = defaultValue;
+        return 1;
+    }
+
+    return 0;
+}
+
+//! \brief Read an integer key, returning 1 if it is not an integer or outside [min, max]
+int ControlMapping::readInt(QSettings &settings, const QString &group, const char *key,
+                            int defaultValue, int min, int max, int &value) {
+    bool ok = true;
+    value = settings.contains(key) ? settings.value(key).toInt(&ok) : defaultValue;
+
+    if (!ok || value < min || value > max) {
+        qDebug() << "Invalid" << key << "for" << group << ":" << settings.value(key).toString()
+                 << "(expected" << min << "to" << max << ")";
+        value = defaultValue;
+        return 1;
+    }
+
+    return 0;
+}
+
+int ControlMapping::addStage(Config &config, const Stage &stage) {
+    if (config.stageCount >= MAPPING_MAX_STAGES) {
+        qDebug() << "Too many mapping stages, the limit is" << MAPPING_MAX_STAGES;
+        return 1;
+    }
+
+    config.stages[config.stageCount++] = stage;
+    return 0;
+}
+
+//! \brief Parse a single "source:weight" input, source being attention, meditation, a band
+//!        name or a ratio of two bands such as theta/lowBeta
+int ControlMapping::parseInput(Config &config, const QString &input) {
+    QStringList parts = input.split(':');
+    QString source = parts.at(0).trimmed();
+
+    Stage stage;
+    stage.param = 1.0f;
+    if (parts.size() == 2) {
+        bool ok = false;
+        stage.param = parts.at(1).trimmed().toFloat(&ok);
+        if (!ok) {
+            qDebug() << "Invalid weight in mapping input:" << input;
+            return 1;
+        }
+    } else if (parts.size() != 1) {
+        qDebug() << "Invalid mapping input:" << input;
+        return 1;
+    }
+
+    if (source == "attention") {
+        stage.type = StageAttention;
+        config.usesAttention = true;
+    } else if (source == "meditation") {
+        stage.type = StageMeditation;
+        config.usesMeditation = true;
+    } else if (source.contains('/')) {
+        QStringList bands = source.split('/');
+        if (bands.size() != 2) {
+            qDebug() << "Invalid band ratio in mapping input:" << input;
+            return 1;
+        }
+
+        stage.type  = StageBandRatio;
+        stage.band  = bandIndex(bands.at(0).trimmed());
+        stage.band2 = bandIndex(bands.at(1).trimmed());
+        if (stage.band < 0 || stage.band2 < 0) {
+            qDebug() << "Invalid band ratio in mapping input:" << input;
+            return 1;
+        }
+        config.usesEegPower = true;
+    } else {
+        stage.type = StageBand;
+        stage.band = bandIndex(source);
+        if (stage.band < 0) {
+            qDebug() << "Unknown mapping input:" << input;
+            return 1;
+        }
+        config.usesEegPower = true;
+    }
+
+    return addStage(config, stage);
+}
+
+int ControlMapping::bandIndex(const QString &name) {
+    static const char *names[8] = {"delta", "theta", "lowAlpha", "highAlpha",
+                                   "lowBeta", "highBeta", "lowGamma", "midGamma"};
+
+    for (int i = 0; i != 8; i++) {
+        if (name == names[i]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+float ControlMapping::bandValue(const asicEegData_t &data, int index) {
+    switch (index) {
+    case 0:  return data.delta;
+    case 1:  return data.theta;
+    case 2:  return data.lowAlpha;
+    case 3:  return data.highAlpha;
+    case 4:  return data.lowBeta;
+    case 5:  return data.highBeta;
+    case 6:  return data.lowGamma;
+    case 7:  return data.midGamma;
+    default: return 0.0f;
+    }
+}
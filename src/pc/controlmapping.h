@@ -0,0 +1,131 @@
+#ifndef CONTROLMAPPING_H
+#define CONTROLMAPPING_H
+
+#include <QObject>
+#include <QSettings>
+#include <QTimer>
+#include <QDebug>
+
+#include "./defines.h"
+#include "./mindwavecontroller.h"
+#include "./arduinointerface.h"
+
+#define MAPPING_MAX_STAGES 16
+
+//! \title ControlMapping
+//!
+//! \brief Maps the signals of one headset to the speed of one car.
+//!
+//! The mapping is read from configuration once and compiled into a fixed array of stages.
+//! Inputs (attention, meditation, relative band powers or band power ratios) are weighted
+//! and summed, passed through an optional dead zone and response curve, then scaled to a
+//! speed. Band powers are the ASIC EEG powers (0x83), the same values the analyser uses, so
+//! weights tuned offline carry over. Evaluating the pipeline performs no heap allocation.
+//!
+//! Configuration keys (within the group passed to configure()):
+//!   inputs   = attention:1.0, theta/lowBeta:0.2   (source:weight list, default attention:1)
+//!   deadZone = 0.2        (inputs below this fraction give zero speed, 0 to below 1, default 0)
+//!   curve    = linear     (linear, quadratic, sqrt, smoothstep or power, default linear)
+//!   gamma    = 2.0        (exponent used by the power curve, 0.01-100)
+//!   gain     = 1.0        (speed = value * 100 * gain, 0-100)
+//!   maxSpeed = 70         (speed limit, 0-100)
+//!   rampTime = 150        (ms the arduino takes to reach each new speed, 0-65535, short so it adds little lag)
+//!   blinkBoost = 0        (speed added while a blink is held, -100 to 100, capped at maxSpeed, negative to brake, 0 disables)
+//!   blinkHold  = 500      (ms a blink boost lasts, 0-60000)
+//!   blinkRampTime = 100   (ms the arduino takes to apply a blink boost, 0-65535)
+//!   maxSlew  = 0          (fastest speed change the arduino allows in percent per second, 0-65535, 0 disables)
+//!
+//! Values which are not numbers or are out of range are rejected rather than clamped.
+//!
+class ControlMapping : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit ControlMapping(QObject *parent = nullptr);
+
+    int configure(QSettings &settings, const QString &group);
+    void attach(MindWaveController *controller, ArduinoInterface *arduino, int player);
+
+    uint8_t evaluate() const;
+    uint8_t getSpeed() const;
+
+ signals:
+    void speedChanged(uint8_t speed);  //! \brief Indicates a new speed has been sent to the car
+
+ public slots:
+    void update();
+    void stop();
+    void blink(uint16_t strength);
+
+ private:
+    enum StageType {
+        StageAttention,   // acc += attention/100 * weight
+        StageMeditation,  // acc += meditation/100 * weight
+        StageBand,        // acc += band/total * weight
+        StageBandRatio,   // acc += band/otherBand * weight
+        StageClamp,       // acc = clamp(acc, 0, 1)
+        StageDeadZone,    // acc = (acc - threshold) / (1 - threshold), or 0 below threshold
+        StageCurve,       // acc = curve(acc)
+    };
+
+    enum CurveType {
+        CurveLinear,
+        CurveQuadratic,
+        CurveSqrt,
+        CurveSmoothstep,
+        CurvePower,
+    };
+
+    struct Stage {
+        StageType type = StageClamp;
+        int   band    = 0;
+        int   band2   = 0;
+        int   curve   = CurveLinear;
+        float param   = 0.0f;
+    };
+
+    //! \brief A compiled mapping, built up by configure() and only adopted once it is valid
+    struct Config {
+        Stage stages[MAPPING_MAX_STAGES];
+        int   stageCount = 0;
+
+        // input dependencies, used to connect only the signals the mapping reads
+        bool usesAttention  = false;
+        bool usesMeditation = false;
+        bool usesEegPower   = false;
+
+        float    gain     = 1.0f;
+        uint8_t  maxSpeed = 70;
+        uint16_t rampTime = 150;
+
+        int      blinkBoost    = 0;
+        int      blinkHold     = 500;
+        uint16_t blinkRampTime = 100;
+
+        uint16_t maxSlew = 0;
+    };
+
+    Config m_config;
+
+    bool     m_boostActive   = false;
+    QTimer   m_blinkTimer;
+
+    MindWaveController *m_controller = nullptr;
+    ArduinoInterface   *m_arduino    = nullptr;
+    int     m_player = 0;
+    uint8_t m_speed  = 0;
+    bool    m_speedSent = false;
+
+    void endBoost();
+
+    static int readFloat(QSettings &settings, const QString &group, const char *key,
+                         float defaultValue, float min, float max, float &value);
+    static int readInt(QSettings &settings, const QString &group, const char *key,
+                       int defaultValue, int min, int max, int &value);
+    static int addStage(Config &config, const Stage &stage);
+    static int parseInput(Config &config, const QString &input);
+    static int bandIndex(const QString &name);
+    static float bandValue(const asicEegData_t &data, int index);
+};
+
+#endif  // CONTROLMAPPING_H
@@ -39,6 +39,51 @@ Q_DECLARE_METATYPE(uchar)
 #define PARSER_SYNC_BYTE            0xAA  /* Syncronization byte */
 #define PARSER_EXCODE_BYTE          0x55  /* EXtended CODE level byte */
 
+/* Arduino command frames (PC -> Arduino), laid out as the telemetry frames below */
+#define ARDUINO_COMMAND_SYNC        0xA5  /* Start of command frame */
+#define ARDUINO_COMMAND_MAX_LENGTH  4     /* Longest command payload */
+
+/* Arduino command codes (PC -> Arduino) */
+#define ARDUINO_CODE_PLAYER1        0x10  /* Car 1 speed (0-100) */
+#define ARDUINO_CODE_PLAYER2        0x20  /* Car 2 speed (0-100) */
+#define ARDUINO_CODE_RAMP_PLAYER1   0x11  /* Car 1 target speed and 2 byte ramp time (ms) */
+#define ARDUINO_CODE_RAMP_PLAYER2   0x21  /* Car 2 target speed and 2 byte ramp time (ms) */
+#define ARDUINO_CODE_SLEW_PLAYER1   0x12  /* Car 1 2 byte max pwm change per tick (8.8) */
+#define ARDUINO_CODE_SLEW_PLAYER2   0x22  /* Car 2 2 byte max pwm change per tick (8.8) */
+#define ARDUINO_CODE_PING           0x30  /* 4 byte token echoed in the pong */
+
+#define ARDUINO_RAMP_TICK           5     /* ms between pwm updates on the arduino */
+
+/* Arduino telemetry frames (Arduino -> PC) */
+#define ARDUINO_TELEMETRY_SYNC      0xA5  /* Start of telemetry frame */
+#define ARDUINO_TELEMETRY_STATUS    0x01  /* Periodic status report */
+#define ARDUINO_TELEMETRY_PONG      0x02  /* Reply to a ping */
+
+/* Connection recovery (all times in ms) */
+#define RECONNECT_INITIAL_DELAY     50    /* First retry after a lost connection */
+#define RECONNECT_MAX_DELAY         2000  /* Backoff limit between retries */
+#define WATCHDOG_INTERVAL           100   /* How often ports are checked for silence */
+#define MINDWAVE_SILENCE_TIMEOUT    500   /* Raw data arrives at 512Hz so this is a dead link */
+#define ARDUINO_SILENCE_TIMEOUT     750   /* Three missed telemetry frames */
+#define MINDWAVE_BOOT_TIMEOUT       3000  /* Headset starting to stream after the handshake */
+#define ARDUINO_BOOT_TIMEOUT        3000  /* Opening the port resets the board, the bootloader alone takes ~1s */
+
+/* Decoder states (Arduino telemetry decoding) */
+#define ARDUINO_STATE_SYNC          0x00  /* Waiting for SYNC byte */
+#define ARDUINO_STATE_TYPE          0x01  /* Waiting for frame type */
+#define ARDUINO_STATE_LENGTH        0x02  /* Waiting for payload[] length */
+#define ARDUINO_STATE_PAYLOAD       0x03  /* Waiting for next payload[] byte */
+#define ARDUINO_STATE_CHKSUM        0x04  /* Waiting for chksum byte */
+
+
+/**
+ * Callback invoked by the Parser for each decoded DataRow value.
+ */
+typedef void (*ThinkGearDataHandler)(uchar extendedCodeLevel,
+                                     uchar code,
+                                     uchar valueLength,
+                                     const uchar *value,
+                                     void *customData);
 
 /**
  * The Parser is a state machine that manages the parsing state.
@@ -55,6 +100,7 @@ typedef struct _ThinkGearStreamParser {
     uchar payloadSum;
     uchar chksum;
 
+    ThinkGearDataHandler handleDataValue;
     void  *customData;
 
 } ThinkGearStreamParser;
@@ -73,15 +119,25 @@ typedef struct _eegPowerData_t{
 Q_DECLARE_METATYPE(eegPowerData_t)
 
 typedef struct _asicEegData_t{
-    uint16_t delta    = 0;
-    uint16_t theta    = 0;
-    uint16_t lowAlpha = 0;
-    uint16_t highAlpha= 0;
-    uint16_t lowBeta  = 0;
-    uint16_t highBeta = 0;
-    uint16_t lowGamma = 0;
-    uint16_t midGamma = 0;
+    uint32_t delta    = 0;
+    uint32_t theta    = 0;
+    uint32_t lowAlpha = 0;
+    uint32_t highAlpha= 0;
+    uint32_t lowBeta  = 0;
+    uint32_t highBeta = 0;
+    uint32_t lowGamma = 0;
+    uint32_t midGamma = 0;
 }asicEegData_t;
 Q_DECLARE_METATYPE(asicEegData_t)
 
+typedef struct _arduinoTelemetry_t{
+    uint16_t loopPeriodAvg = 0;  /* microseconds */
+    uint16_t loopPeriodMax = 0;  /* microseconds */
+    uint8_t  car1State     = 0;  /* pwm duty cycle (0-255) */
+    uint8_t  car2State     = 0;  /* pwm duty cycle (0-255) */
+    uint16_t rxOverruns    = 0;
+    uint16_t parseErrors   = 0;
+}arduinoTelemetry_t;
+Q_DECLARE_METATYPE(arduinoTelemetry_t)
+
 #endif  // DEFINES_H
@@ -0,0 +1,253 @@
+#include "./jitterbuffer.h"
+
+#include <cstring>
+
+JitterBuffer::JitterBuffer() {
+    reset();
+}
+
+//! \brief Set the function released values are passed to
+void JitterBuffer::setHandler(ThinkGearDataHandler handleDataValue, void *customData) {
+    m_handleDataValue = handleDataValue;
+    m_customData = customData;
+}
+
+//! \brief Set the playout delay in microseconds, a delay of 0 passes values straight through
+void JitterBuffer::setDelay(int64_t delay) {
+    m_delay = delay > 0 ? delay : 0;
+
+    if (m_delay == 0) {
+        // nothing should be held back any more
+        while (m_count) {
+            release();
+        }
+    }
+}
+
+int64_t JitterBuffer::getDelay() const {
+    return m_delay;
+}
+
+//! \brief Drop pending values and the clock estimate, e.g. after a reconnect
+void JitterBuffer::reset() {
+    m_head  = 0;
+    m_count = 0;
+
+    m_sampleCount    = 0;
+    m_firstArrival   = 0;
+    m_blockMinOffset = 0.0;
+    m_blockMinTime   = 0.0;
+    m_blockHasSample = false;
+
+    m_pointHead  = 0;
+    m_pointCount = 0;
+
+    m_intercept = 0.0;
+    m_skew      = 0.0;
+}
+
+//! \brief Record the arrival of a raw sample, which advances the headset's sample clock
+void JitterBuffer::sampleArrived(int64_t arrival) {
+    if (m_sampleCount == 0) {
+        m_firstArrival = arrival;
+    }
+
+    double time   = static_cast<double>(sampleTime(m_sampleCount));
+    double offset = static_cast<double>(arrival - m_firstArrival) - time;
+
+    if (!m_blockHasSample || offset < m_blockMinOffset) {
+        m_blockMinOffset = offset;
+        m_blockMinTime   = time;
+        m_blockHasSample = true;
+    }
+
+    advanceClock();
+
+    if (m_pointCount == 0 && m_blockHasSample) {
+        // no complete block yet, use the least delayed sample so far
+        m_intercept = m_blockMinOffset;
+        m_skew      = 0.0;
+    }
+}
+
+//! \brief Record a packet lost to a checksum error
+//!
+//! Nearly every packet carries a raw sample, so the headset's sample clock is advanced by one
+//! sample to keep later samples at their true sample time.
+//!
+void JitterBuffer::sampleLost() {
+    if (m_sampleCount == 0) {
+        return;  // the clock starts at the first sample received
+    }
+
+    advanceClock();
+}
+
+//! \brief Queue a decoded value for release on the shared timeline
+void JitterBuffer::push(uchar extendedCodeLevel, uchar code, uchar valueLength, const uchar *value,
+                        int64_t arrival) {
+    if (m_delay == 0 || valueLength > JITTER_BUFFER_MAX_VALUE) {
+        if (m_handleDataValue) {
+            m_handleDataValue(extendedCodeLevel, code, valueLength, value, m_customData);
+        }
+        return;
+    }
+
+    if (m_count == JITTER_BUFFER_CAPACITY) {
+        release();  // full, so the oldest value goes early rather than being lost
+    }
+
+    int64_t releaseTime = arrival + m_delay;
+    if (m_sampleCount != 0) {
+        // release relative to when the least delayed path would have delivered it
+        double time = static_cast<double>(sampleTime(m_sampleCount - 1));
+        releaseTime = m_firstArrival + static_cast<int64_t>(time + m_intercept + m_skew * time) + m_delay;
+    }
+
+    if (releaseTime < arrival) {
+        releaseTime = arrival;
+        m_lateCount++;
+    } else if (releaseTime > arrival + m_delay) {
+        releaseTime = arrival + m_delay;
+    }
+
+    // keep values in order
+    if (m_count) {
+        const Entry &tail = m_entries[(m_head + m_count - 1) % JITTER_BUFFER_CAPACITY];
+        if (releaseTime < tail.releaseTime) {
+            releaseTime = tail.releaseTime;
+        }
+    }
+
+    Entry &entry = m_entries[(m_head + m_count) % JITTER_BUFFER_CAPACITY];
+    entry.releaseTime       = releaseTime;
+    entry.extendedCodeLevel = extendedCodeLevel;
+    entry.code              = code;
+    entry.valueLength       = valueLength;
+    std::memcpy(entry.value, value, valueLength);
+    m_count++;
+}
+
+//! \brief Pass every value due at or before the given time to the handler
+void JitterBuffer::releaseDue(int64_t time) {
+    while (m_count && m_entries[m_head].releaseTime <= time) {
+        release();
+    }
+}
+
+bool JitterBuffer::hasPending() const {
+    return m_count != 0;
+}
+
+int64_t JitterBuffer::nextReleaseTime() const {
+    return m_count ? m_entries[m_head].releaseTime : 0;
+}
+
+//! \brief Estimated drift of the headset clock against the local clock, in parts per million
+double JitterBuffer::getSkew() const {
+    return m_skew * 1e6;
+}
+
+//! \brief Number of values which arrived after their release time
+uint64_t JitterBuffer::getLateCount() const {
+    return m_lateCount;
+}
+
+//! \brief Time of a raw sample in microseconds since the first sample, at 512Hz
+int64_t JitterBuffer::sampleTime(uint64_t sample) {
+    return static_cast<int64_t>(sample * 15625 / 8);
+}
+
+//! \brief Count one sample and record a clock point at the end of each block
+void JitterBuffer::advanceClock() {
+    m_sampleCount++;
+
+    if (m_sampleCount % JITTER_CLOCK_BLOCK != 0) {
+        return;
+    }
+
+    // a block may end on a lost sample, it only gives a point if any of its samples arrived
+    if (m_blockHasSample) {
+        ClockPoint &point = m_points[(m_pointHead + m_pointCount) % JITTER_CLOCK_BLOCKS];
+        point.sampleTime = m_blockMinTime;
+        point.offset     = m_blockMinOffset;
+
+        if (m_pointCount < JITTER_CLOCK_BLOCKS) {
+            m_pointCount++;
+        } else {
+            m_pointHead = (m_pointHead + 1) % JITTER_CLOCK_BLOCKS;
+        }
+
+        fitClock();
+    }
+
+    m_blockHasSample = false;
+}
+
+//! \brief Fit the offset line through the lower envelope of the recorded clock points
+void JitterBuffer::fitClock() {
+    double minOffset = m_points[m_pointHead].offset;
+    for (int i = 1; i < m_pointCount; i++) {
+        const ClockPoint &point = m_points[(m_pointHead + i) % JITTER_CLOCK_BLOCKS];
+        if (point.offset < minOffset) {
+            minOffset = point.offset;
+        }
+    }
+
+    // too few points for a stable drift estimate
+    if (m_pointCount < 4) {
+        m_intercept = minOffset;
+        m_skew      = 0.0;
+        return;
+    }
+
+    double meanTime = 0.0, meanOffset = 0.0;
+    for (int i = 0; i != m_pointCount; i++) {
+        const ClockPoint &point = m_points[(m_pointHead + i) % JITTER_CLOCK_BLOCKS];
+        meanTime   += point.sampleTime;
+        meanOffset += point.offset;
+    }
+    meanTime   /= m_pointCount;
+    meanOffset /= m_pointCount;
+
+    double covariance = 0.0, variance = 0.0;
+    for (int i = 0; i != m_pointCount; i++) {
+        const ClockPoint &point = m_points[(m_pointHead + i) % JITTER_CLOCK_BLOCKS];
+        covariance += (point.sampleTime - meanTime) * (point.offset - meanOffset);
+        variance   += (point.sampleTime - meanTime) * (point.sampleTime - meanTime);
+    }
+
+    m_skew = variance > 0.0 ? covariance / variance : 0.0;
+
+    // crystal drift is far below 0.1%, anything larger is a disturbance of the link
+    if (m_skew > 1e-3) {
+        m_skew = 1e-3;
+    } else if (m_skew < -1e-3) {
+        m_skew = -1e-3;
+    }
+
+    // shift the line down onto the lower envelope of the points
+    m_intercept = meanOffset - m_skew * meanTime;
+    double minResidual = 0.0;
+    for (int i = 0; i != m_pointCount; i++) {
+        const ClockPoint &point = m_points[(m_pointHead + i) % JITTER_CLOCK_BLOCKS];
+        double residual = point.offset - (m_intercept + m_skew * point.sampleTime);
+        if (i == 0 || residual < minResidual) {
+            minResidual = residual;
+        }
+    }
+    m_intercept += minResidual;
+}
+
+//! \brief Pass the oldest pending value to the handler
+void JitterBuffer::release() {
+    // copy first so the handler may safely queue further values
+    Entry entry = m_entries[m_head];
+    m_head = (m_head + 1) % JITTER_BUFFER_CAPACITY;
+    m_count--;
+
+    if (m_handleDataValue) {
+        m_handleDataValue(entry.extendedCodeLevel, entry.code, entry.valueLength,
+                          entry.value, m_customData);
+    }
+}
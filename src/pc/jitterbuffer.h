@@ -0,0 +1,98 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <cstdint>
+
+#include "./defines.h"
+
+#define JITTER_BUFFER_CAPACITY      64    /* Pending decoded values */
+#define JITTER_BUFFER_MAX_VALUE     32    /* Longest value that is buffered, longer ones pass straight through */
+#define JITTER_CLOCK_BLOCK          256   /* Raw samples per clock estimate point (0.5s) */
+#define JITTER_CLOCK_BLOCKS         32    /* Estimate points used to fit the clock (16s) */
+
+//! \title JitterBuffer
+//!
+//! \brief Holds decoded values back so they are released on a steady, drift corrected timeline.
+//!
+//! The headset's sample clock is reconstructed from the count of 512Hz raw samples. For every
+//! block of samples the smallest difference between arrival time and sample time is recorded;
+//! a line fitted through the lower envelope of these points gives the clock offset and drift
+//! relative to the local clock along the least delayed path. Packets lost to checksum errors
+//! still advance the sample count, so the clock does not fall behind the headset. Each
+//! decoded value is stamped with the sample time it arrived at and released at that time on
+//! the local clock plus a fixed delay, so bursts from the Bluetooth link are smoothed out. A
+//! value is never held for longer than the delay, and values which arrive late are released
+//! immediately.
+//!
+//! All times are microseconds on the shared clock returned by monotonicMicros(), so buffers of several
+//! headsets with the same delay release onto one timeline. Decoded values are handed back
+//! through a ThinkGearDataHandler, matching the stream parser.
+//!
+class JitterBuffer {
+ public:
+    JitterBuffer();
+
+    void setHandler(ThinkGearDataHandler handleDataValue, void *customData);
+
+    void setDelay(int64_t delay);
+    int64_t getDelay() const;
+
+    void reset();
+
+    void sampleArrived(int64_t arrival);
+    void sampleLost();
+    void push(uchar extendedCodeLevel, uchar code, uchar valueLength, const uchar *value, int64_t arrival);
+
+    void releaseDue(int64_t time);
+    bool hasPending() const;
+    int64_t nextReleaseTime() const;
+
+    double getSkew() const;
+    uint64_t getLateCount() const;
+
+ private:
+    struct Entry {
+        int64_t releaseTime;
+        uchar   extendedCodeLevel;
+        uchar   code;
+        uchar   valueLength;
+        uchar   value[JITTER_BUFFER_MAX_VALUE];
+    };
+
+    struct ClockPoint {
+        double sampleTime;
+        double offset;
+    };
+
+    ThinkGearDataHandler m_handleDataValue = nullptr;
+    void *m_customData = nullptr;
+
+    int64_t m_delay = 0;
+
+    Entry m_entries[JITTER_BUFFER_CAPACITY];
+    int   m_head  = 0;
+    int   m_count = 0;
+
+    // device clock reconstruction
+    uint64_t m_sampleCount  = 0;
+    int64_t  m_firstArrival = 0;
+    double   m_blockMinOffset = 0.0;
+    double   m_blockMinTime   = 0.0;
+    bool     m_blockHasSample = false;
+
+    ClockPoint m_points[JITTER_CLOCK_BLOCKS];
+    int   m_pointHead  = 0;
+    int   m_pointCount = 0;
+
+    double m_intercept = 0.0;  // offset at sample time 0
+    double m_skew      = 0.0;  // offset change per unit of sample time
+
+    uint64_t m_lateCount = 0;
+
+    static int64_t sampleTime(uint64_t sample);
+    void advanceClock();
+    void fitClock();
+    void release();
+};
+
+#endif  // JITTERBUFFER_H
@@ -1,27 +1,56 @@
 #include <QCoreApplication>
 
 #include <QTimer>
+#include <QSettings>
+#include <QFileInfo>
 
 #include "./mindwavecontroller.h"
 #include "./arduinointerface.h"
+#include "./controlmapping.h"
 
-const uint8_t maxSpeed= 70;
+const int jitterBufferDelay = 100;  // ms
 
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);
 
-    if (app.arguments().size() != 4) {
+    if (app.arguments().size() != 4 && app.arguments().size() != 5) {
         qDebug() << "Invalid Arguments provided";
-        qDebug() << "Correct arguement syntax is [MindWaveSerialPort1] [MindWaveSerialPort2] [ArduinoSerialPort]";
+        qDebug() << "Correct arguement syntax is [MindWaveSerialPort1] [MindWaveSerialPort2] [ArduinoSerialPort] [MappingConfig (optional)]";
         return 1;
     }
 
+    // map each headset to its car, by default attention drives speed up to a limit of 70
+    ControlMapping mapping1;
+    ControlMapping mapping2;
+    if (app.arguments().size() == 5) {
+        // QSettings treats a missing file as empty, which would silently give the defaults
+        QFileInfo mappingFile(app.arguments().at(4));
+        if (!mappingFile.exists() || !mappingFile.isReadable()) {
+            qDebug() << "Mapping config" << app.arguments().at(4) << "does not exist or is not readable";
+            return 4;
+        }
+
+        QSettings mappingConfig(app.arguments().at(4), QSettings::IniFormat);
+        if (mappingConfig.status() != QSettings::NoError) {
+            qDebug() << "Failed to read mapping config" << app.arguments().at(4);
+            return 4;
+        }
+
+        if (mapping1.configure(mappingConfig, "player1") || mapping2.configure(mappingConfig, "player2")) {
+            return 4;  // invalid mapping configuration
+        }
+    }
+
+    // both headsets release their values on one timeline with the same delay so neither
+    // player gets a head start from a faster bluetooth link
     MindWaveController controller1;
+    controller1.setJitterBufferDelay(jitterBufferDelay);
     if (controller1.initController(app.arguments().at(1))) {
         return 2;  // failed to open Serial Port with MindWave controller
     }
 
     MindWaveController controller2;
+    controller2.setJitterBufferDelay(jitterBufferDelay);
     if (controller2.initController(app.arguments().at(2))) {
         return 2;  // failed to open Serial Port with MindWave controller
     }
@@ -32,39 +61,15 @@ int main(int argc, char *argv[]) {
     }
 
     // write BCI data to Arduino
-    // changed the connected signal to change the output data written to the arduino
-    arduino.connect(&controller1, &MindWaveController::attentionDataChanged,
-                       [&](uint16_t data){
-        QByteArray outputdata;
-        outputdata.append(0x10);
+    // change the mapping configuration to change the output data written to the arduino
+    mapping1.attach(&controller1, &arduino, 1);
+    mapping2.attach(&controller2, &arduino, 2);
 
-        if (data > maxSpeed) {
-            outputdata.append(maxSpeed);
-        } else {
-            outputdata.append(data&0xFF);
-        }
-
-        qDebug() << "Player Code: " << static_cast<uint8_t>(outputdata.at(0))
-                 << "Player Level: "<< static_cast<uint8_t>(outputdata.at(1));
-
-        arduino.write(outputdata);
+    mapping1.connect(&mapping1, &ControlMapping::speedChanged, [](uint8_t speed){
+        qDebug() << "Player: " << 1 << "Player Level: " << static_cast<int>(speed);
     });
-
-    arduino.connect(&controller2, &MindWaveController::attentionDataChanged,
-                       [&](uint16_t data){
-        QByteArray outputdata;
-        outputdata.append(0x20);
-
-        if (data > maxSpeed) {
-            outputdata.append(maxSpeed);
-        } else {
-            outputdata.append(data&0xFF);
-        }
-
-        qDebug() << "Player Code: " << static_cast<uint8_t>(outputdata.at(0))
-                 << "Player Level: "<< static_cast<uint8_t>(outputdata.at(1));
-
-        arduino.write(outputdata);
+    mapping2.connect(&mapping2, &ControlMapping::speedChanged, [](uint8_t speed){
+        qDebug() << "Player: " << 2 << "Player Level: " << static_cast<int>(speed);
     });
 
     return app.exec(); // start event loop
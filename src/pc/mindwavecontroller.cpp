@@ -1,14 +1,45 @@
 #include "./mindwavecontroller.h"
 
-MindWaveController::MindWaveController(QObject *parent) : QObject(parent) {
-    initParser(PARSER_TYPE_PACKETS, NULL);
+#include <cstring>
 
-    connect(&serialPort, SIGNAL(readyRead()), this, SLOT(read()));
+#include "./monotonicclock.h"
+
+MindWaveController::MindWaveController(QObject *parent)
+    : QObject(parent), m_link("MindWaveMobile") {
+    initParser(PARSER_TYPE_PACKETS, this);
+
+    // eSense values arrive once a second, raw samples at 512Hz
+    m_history[SignalHistory].setCapacity(256);
+    m_history[HeartRateHistory].setCapacity(256);
+    m_history[AttentionHistory].setCapacity(256);
+    m_history[MeditationHistory].setCapacity(256);
+    m_history[Raw16BitHistory].setCapacity(4096);
+    m_history[RrIntervalHistory].setCapacity(256);
+
+    connect(&m_link, SIGNAL(dataReceived(QByteArray,qint64)), this, SLOT(read(QByteArray,qint64)));
+    connect(&m_link, SIGNAL(openFailed()), this, SIGNAL(serialConnectionFailed()));
+    connect(&m_link, SIGNAL(connectedChanged(bool)), this, SIGNAL(connectedChanged(bool)));
+    connect(&m_link, SIGNAL(connectionLost()), this, SLOT(handleConnectionLost()));
+    connect(&m_link, SIGNAL(reconnected()), this, SLOT(handleReconnected()));
+
+    // Write command bits to MindWaveMobile after every open
+    // 0x02 enables 57.6k baud raw transfers
+    QByteArray mindWaveControlInfo;
+    mindWaveControlInfo.append(0x03);
+    m_link.setHandshake(buildPacket(mindWaveControlInfo), QSerialPort::Baud57600);
+    m_link.setSilenceTimeout(MINDWAVE_SILENCE_TIMEOUT);
+    m_link.setBootTimeout(MINDWAVE_BOOT_TIMEOUT);
+
+    m_jitterBuffer.setHandler(&MindWaveController::releaseDataValue, this);
+    connect(&m_jitterTimer, SIGNAL(timeout()), this, SLOT(releaseJitterBuffer()));
+    m_jitterTimer.setSingleShot(true);
+    m_jitterTimer.setTimerType(Qt::PreciseTimer);
 }
 
 //! \brief Close the current serial port
 MindWaveController::~MindWaveController() {
-    serialPort.close();
+    m_jitterTimer.stop();
+    m_link.close();
 }
 
 //! \brief A More C-Friendly way of enabling serial communications
@@ -17,30 +48,45 @@ int MindWaveController::initController(const QString portName) {
 
     m_portName = portName;
 
-    // Set Port Information
-    serialPort.setPortName(m_portName);
-    serialPort.setBaudRate(QSerialPort::Baud9600);
-
-    if (!serialPort.open(QIODevice::ReadWrite)) {
+    // Set Port Information, the link sends the handshake and switches to 57.6k baud
+    if (m_link.open(m_portName, QSerialPort::Baud9600)) {
         qDebug() << "Failed to Open Serial Port";
-        emit serialConnectionFailed();
         return 1;
     }
 
-    // Write command bits to MindWaveMobile
-    // 0x02 enables 57.6k baud raw transfers
-    QByteArray mindWaveControlInfo;
-    mindWaveControlInfo.append(0x03);
-    writeSerialData(mindWaveControlInfo);
-    serialPort.setBaudRate(QSerialPort::Baud57600);
-
     qDebug() << "Initialization Complete.";
-    m_connectionState = true;
     emit serialConnectionSuccess();
 
     return 0;
 }
 
+//! \brief Retrieve the sample history of a channel
+//!
+//! Consumers needing moving statistics should register a window with addWindow() rather
+//! than keeping their own copy of the data.
+//!
+const ChannelHistory &MindWaveController::history(HistoryChannel channel) const {
+    return m_history[channel];
+}
+
+//! \brief Register a window over the most recent \a length samples of a channel
+//!
+//! Returns the index to pass to the history's window queries, or -1 if the channel or
+//! length is invalid.
+//!
+int MindWaveController::addWindow(HistoryChannel channel, size_t length) {
+    if (channel < 0 || channel >= HistoryChannelCount) {
+        qDebug() << "Invalid history channel: " << channel;
+        return -1;
+    }
+
+    return m_history[channel].addWindow(length);
+}
+
+BlinkDetector &MindWaveController::getBlinkDetector() {
+    return m_blinkDetector;
+}
+
 //! \brief Set's the serial port and automatically initiallises the connection
 void MindWaveController::setPortName(const QString portName)  {
     initController(portName);
@@ -53,26 +99,80 @@ QString MindWaveController::getPortName() const {
 
 //! \brief Return the current connection state of the serial port
 bool MindWaveController::isConnected() const {
-    return m_connectionState;
+    return m_link.isConnected();
 }
 
 //! \brief Close the current serial port
 int MindWaveController::close() {
-    if (!serialPort.isOpen()) {
+    if (!m_link.isConnected()) {
         qDebug() << "Error, Serial Port is not open";
-        return 1;
-    }
 
-    if (!m_connectionState) {
-        qDebug() << "Something Went wrong here";
-        return 2;
+        // a deliberate close still cancels any pending reconnect
+        m_link.close();
+        return 1;
     }
 
-    serialPort.close();
-    m_connectionState = false;
+    m_link.close();
     return 0;
 }
 
+bool MindWaveController::getAutoReconnect() const {
+    return m_link.getAutoReconnect();
+}
+
+//! \brief Enable or disable reconnecting in the background after a port error or silence
+void MindWaveController::setAutoReconnect(bool enabled) {
+    m_link.setAutoReconnect(enabled);
+}
+
+int MindWaveController::getSilenceTimeout() const {
+    return m_link.getSilenceTimeout();
+}
+
+//! \brief Set how long the port may go without data (in ms) before it is treated as disconnected
+void MindWaveController::setSilenceTimeout(int msec) {
+    m_link.setSilenceTimeout(msec);
+}
+
+int MindWaveController::getJitterBufferDelay() const {
+    return static_cast<int>(m_jitterBuffer.getDelay() / 1000);
+}
+
+//! \brief Hold decoded values (not raw samples) for up to msec so they are released on a
+//!        steady, drift corrected timeline shared with other headsets. 0 disables the buffer.
+//!
+//! Giving every headset the same delay gives every lane the same, low variance latency.
+//!
+void MindWaveController::setJitterBufferDelay(int msec) {
+    m_jitterBuffer.setDelay(static_cast<int64_t>(msec) * 1000);
+    scheduleJitterRelease();
+}
+
+//! \brief Estimated drift of the headset sample clock against the PC clock, in ppm
+double MindWaveController::getClockSkew() const {
+    return m_jitterBuffer.getSkew();
+}
+
+//! \brief Drop all state belonging to the lost connection
+//!
+//! Values still held in the jitter buffer are discarded rather than released after the
+//! connection has gone, which would drive the car after consumers have stopped it.
+//!
+void MindWaveController::handleConnectionLost() {
+    // discard any partially received packet, the old raw signal baseline and the old sample clock
+    initParser(PARSER_TYPE_PACKETS, parser.customData);
+    m_blinkDetector.reset();
+    m_jitterTimer.stop();
+    m_jitterBuffer.reset();
+
+    emit connectionLost();
+}
+
+void MindWaveController::handleReconnected() {
+    qDebug() << "MindWaveMobile reconnected on" << m_portName;
+    emit reconnected();
+}
+
 //! \brief Decode function to parse payload packets recieved serially
 void MindWaveController::parseSerialData(uchar extendedCodeLevel,
                                          uchar code,
@@ -88,21 +188,25 @@ void MindWaveController::parseSerialData(uchar extendedCodeLevel,
 
         case 0x02:
             m_signalData = value[0] & 0xFF;
+            m_history[SignalHistory].push(m_signalData);
             emit signalDataChanged(m_signalData);
             break;
 
         case 0x03:
             m_heartRateData = value[0] & 0xFF;
+            m_history[HeartRateHistory].push(m_heartRateData);
             emit heartRateDataChanged(m_heartRateData);
             break;
 
         case 0x04:
             m_attentionData = value[0] & 0xFF;
+            m_history[AttentionHistory].push(m_attentionData);
             emit attentionDataChanged(m_attentionData);
             break;
 
         case 0x05:
             m_meditationData = value[0] & 0xFF;
+            m_history[MeditationHistory].push(m_meditationData);
             emit meditationDataChanged(m_attentionData);
             break;
 
@@ -116,37 +220,52 @@ void MindWaveController::parseSerialData(uchar extendedCodeLevel,
 
         case 0x80:
             m_raw16BitData = (value[0]<<8) | value[1];
+            m_history[Raw16BitHistory].push(static_cast<int16_t>(m_raw16BitData));  // raw samples are signed
             emit raw16BitDataChanged(m_raw16BitData);
+
+            switch (m_blinkDetector.process(static_cast<int16_t>(m_raw16BitData))) {
+            case BlinkDetector::BlinkEvent:
+                emit blinkDetected(m_blinkDetector.getStrength());
+                break;
+            case BlinkDetector::ArtifactEvent:
+                emit artifactDetected(m_blinkDetector.getStrength());
+                break;
+            default:
+                break;
+            }
             break;
 
         case 0x81:
-            m_eegPowerData.delta    = ( (value[0]&0xFF)<<24)  |  ((value[1]&0xFF)<<16) |  ((value[2]&0xFF)<<8) |  (value[3]&0xFF);
-            m_eegPowerData.theta    = ( (value[4]&0xFF)<<24)  |  ((value[5]&0xFF)<<16) |  ((value[6]&0xFF)<<8) |  (value[7]&0xFF);
-            m_eegPowerData.lowAlpha = ( (value[8]&0xFF)<<24)  |  ((value[9]&0xFF)<<16) | ((value[10]&0xFF)<<8) | (value[11]&0xFF);
-            m_eegPowerData.highAlpha= ((value[12]&0xFF)<<24)  | ((value[13]&0xFF)<<16) | ((value[14]&0xFF)<<8) | (value[15]&0xFF);
-            m_eegPowerData.lowBeta  = ((value[16]&0xFF)<<24)  | ((value[17]&0xFF)<<16) | ((value[18]&0xFF)<<8) | (value[19]&0xFF);
-            m_eegPowerData.highBeta = ((value[20]&0xFF)<<24)  | ((value[21]&0xFF)<<16) | ((value[22]&0xFF)<<8) | (value[23]&0xFF);
-            m_eegPowerData.lowGamma = ((value[24]&0xFF)<<24)  | ((value[25]&0xFF)<<16) | ((value[26]&0xFF)<<8) | (value[27]&0xFF);
-            m_eegPowerData.midGamma = ((value[28]&0xFF)<<24)  | ((value[29]&0xFF)<<16) | ((value[30]&0xFF)<<8) | (value[31]&0xFF);
+            // eight 4 byte big endian IEEE-754 floats
+            m_eegPowerData.delta     = decodeFloat(value);
+            m_eegPowerData.theta     = decodeFloat(value + 4);
+            m_eegPowerData.lowAlpha  = decodeFloat(value + 8);
+            m_eegPowerData.highAlpha = decodeFloat(value + 12);
+            m_eegPowerData.lowBeta   = decodeFloat(value + 16);
+            m_eegPowerData.highBeta  = decodeFloat(value + 20);
+            m_eegPowerData.lowGamma  = decodeFloat(value + 24);
+            m_eegPowerData.midGamma  = decodeFloat(value + 28);
             convertEegPowerDataToVariant();
             emit eegPowerDataChanged(m_eegPowerDataMap);
             break;
 
         case 0x083:
+            // eight 3 byte big endian unsigned integers
             m_asicEegData.delta    = ( (value[0]&0xFF)<<16) |  ((value[1]&0xFF)<<8) |  (value[2]&0xFF);
             m_asicEegData.theta    = ( (value[3]&0xFF)<<16) |  ((value[4]&0xFF)<<8) |  (value[5]&0xFF);
-            m_asicEegData.lowAlpha = ( (value[8]&0xFF)<<16) |  ((value[9]&0xFF)<<8) | (value[10]&0xFF);
-            m_asicEegData.highAlpha= ((value[12]&0xFF)<<16) | ((value[13]&0xFF)<<8) | (value[14]&0xFF);
-            m_asicEegData.lowBeta  = ((value[16]&0xFF)<<16) | ((value[17]&0xFF)<<8) | (value[18]&0xFF);
-            m_asicEegData.highBeta = ((value[20]&0xFF)<<16) | ((value[21]&0xFF)<<8) | (value[22]&0xFF);
-            m_asicEegData.lowGamma = ((value[24]&0xFF)<<16) | ((value[25]&0xFF)<<8) | (value[26]&0xFF);
-            m_asicEegData.midGamma = ((value[28]&0xFF)<<16) | ((value[29]&0xFF)<<8) | (value[30]&0xFF);
+            m_asicEegData.lowAlpha = ( (value[6]&0xFF)<<16) |  ((value[7]&0xFF)<<8) |  (value[8]&0xFF);
+            m_asicEegData.highAlpha= ( (value[9]&0xFF)<<16) | ((value[10]&0xFF)<<8) | (value[11]&0xFF);
+            m_asicEegData.lowBeta  = ((value[12]&0xFF)<<16) | ((value[13]&0xFF)<<8) | (value[14]&0xFF);
+            m_asicEegData.highBeta = ((value[15]&0xFF)<<16) | ((value[16]&0xFF)<<8) | (value[17]&0xFF);
+            m_asicEegData.lowGamma = ((value[18]&0xFF)<<16) | ((value[19]&0xFF)<<8) | (value[20]&0xFF);
+            m_asicEegData.midGamma = ((value[21]&0xFF)<<16) | ((value[22]&0xFF)<<8) | (value[23]&0xFF);
             convertAsicEegDataToVariant();
             emit asicEegDataChanged(m_asicEegDataMap);
             break;
 
         case 0x86:
             m_rrIntervalData = (value[0]<<8) | value[1];
+            m_history[RrIntervalHistory].push(m_rrIntervalData);
             emit rrIntervalDataChanged(m_rrIntervalData);
             break;
 
@@ -165,13 +284,8 @@ void MindWaveController::parseSerialData(uchar extendedCodeLevel,
     }
 }
 
-//! \brief Write data serially to the open Serial Port
-void MindWaveController::writeSerialData(const QByteArray &data) {
-    if (data.count()>169) {
-        qDebug() << "Payload too large. Max payload size is 169 Bytes";
-        return;
-    }
-
+//! \brief Wrap a payload in a ThinkGear packet
+QByteArray MindWaveController::buildPacket(const QByteArray &data) {
     // create ThinkGearPacket
     QByteArray writeData;
     writeData.append(0xAA);              // SYNC BYTE
@@ -189,31 +303,18 @@ void MindWaveController::writeSerialData(const QByteArray &data) {
 
     writeData.append(chksum);  // CHKSUM
 
-    uint64_t bytesWritten = serialPort.write(writeData);
-    qDebug() << "MindWaveMobile Data Sent...";
-
-    if (bytesWritten == -1) {
-        qDebug() << "Failed to write the data to port";
-        return;
-    } else if (bytesWritten != writeData.size()) {
-        qDebug() << "Failed to write all the data to port";
-        return;
-    } else if (!serialPort.waitForBytesWritten(5000)) {
-        qDebug() << "Operation timed out or an error occurred for port";
-        return;
-    }
-
-    qDebug() << "Data Write Sucessfull";
-    return;
+    return writeData;
 }
 
-//! \brief Reads all available data in the buffer.
-//!        This function is triggered by the readReady() signal of QSerialPort
-void MindWaveController::read() {
-    QByteArray data = serialPort.readAll();
+//! \brief Parses data read by the serial link, arrival being its time on the monotonicMicros() clock
+void MindWaveController::read(const QByteArray &data, qint64 arrival) {
+    m_arrival = arrival;
 
     for (auto &x : data) {
-        parseByte(x);
+        // a packet failing its checksum has almost certainly lost a raw sample
+        if (parseByte(x) == -2) {
+            m_jitterBuffer.sampleLost();
+        }
     }
 }
 
@@ -254,6 +355,16 @@ QVariantMap MindWaveController::getEegPowerData() {
     return m_eegPowerDataMap;
 }
 
+//! \brief Latest EEG band powers without the QVariantMap conversion
+const eegPowerData_t &MindWaveController::getEegPowerValues() const {
+    return m_eegPowerData;
+}
+
+//! \brief Latest ASIC EEG band powers without the QVariantMap conversion
+const asicEegData_t &MindWaveController::getAsicEegValues() const {
+    return m_asicEegData;
+}
+
 QVariantMap MindWaveController::getAsicEegData() {
     convertAsicEegDataToVariant();
     return m_asicEegDataMap;
@@ -281,156 +392,76 @@ void MindWaveController::convertAsicEegDataToVariant() {
     m_asicEegDataMap["midGamma"]  = static_cast<int>(m_asicEegData.midGamma);
 }
 
-int MindWaveController::initParser(uchar parserType,
-                      void *customData ) {
-    /* Initialize the parser's state based on the parser type */
-    switch (parserType) {
-        case PARSER_TYPE_PACKETS:
-            parser.state = PARSER_STATE_SYNC;
-            break;
-        case PARSER_TYPE_2BYTERAW:
-            parser.state = PARSER_STATE_WAIT_HIGH;
-            break;
-        default: return( -2 );
-    }
-
-    /* Save parser type */
-    parser.type = parserType;
+//! \brief Decode a 4 byte big endian IEEE-754 float
+float MindWaveController::decodeFloat(const uchar *value) {
+    quint32 bits = (static_cast<quint32>(value[0])<<24) | (static_cast<quint32>(value[1])<<16) |
+                   (static_cast<quint32>(value[2])<<8)  |  static_cast<quint32>(value[3]);
 
-    /* Save user-defined handler function and data pointer */
-    parser.customData = customData;
-
-    return 0;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
 }
 
-int MindWaveController::parseByte(uchar byte ) {
-    int returnValue = 0;
-
-    /* Pick handling according to current state... */
-    switch (parser.state) {
-        /* Waiting for SyncByte */
-        case PARSER_STATE_SYNC:
-            if (byte == PARSER_SYNC_BYTE) {
-                parser.state = PARSER_STATE_SYNC_CHECK;
-            }
-            break;
-
-        /* Waiting for second SyncByte */
-        case PARSER_STATE_SYNC_CHECK:
-            if (byte == PARSER_SYNC_BYTE) {
-                parser.state = PARSER_STATE_PAYLOAD_LENGTH;
-            } else {
-                parser.state = PARSER_STATE_SYNC;
-            }
-            break;
-
-        /* Waiting for Data[] length */
-        case PARSER_STATE_PAYLOAD_LENGTH:
-            parser.payloadLength = byte;
-            if (parser.payloadLength > 170) {
-                parser.state = PARSER_STATE_SYNC;
-                returnValue = -3;
-            } else if (parser.payloadLength == 170) {
-                returnValue = -4;
-            } else {
-                parser.payloadBytesReceived = 0;
-                parser.payloadSum = 0;
-                parser.state = PARSER_STATE_PAYLOAD;
-            }
-            break;
-
-        /* Waiting for Payload[] bytes */
-        case PARSER_STATE_PAYLOAD:
-            parser.payload[parser.payloadBytesReceived++] = byte;
-            parser.payloadSum = static_cast<uchar>(parser.payloadSum + byte);
-            if (parser.payloadBytesReceived >= parser.payloadLength) {
-                parser.state = PARSER_STATE_CHKSUM;
-            }
-            break;
-
-        /* Waiting for CKSUM byte */
-        case PARSER_STATE_CHKSUM:
-            parser.chksum = byte;
-            parser.state = PARSER_STATE_SYNC;
-            if (parser.chksum != ((~parser.payloadSum)&0xFF)) {
-                returnValue = -2;
-            } else {
-                returnValue = 1;
-                parsePacketPayload();
-            }
-            break;
-
-        /* Waiting for high byte of 2-byte raw value */
-        case PARSER_STATE_WAIT_HIGH:
-
-            /* Check if current byte is a high byte */
-            if ((byte & 0xC0) == 0x80) {
-                /* High byte recognized, will be saved as parser.lastByte */
-                parser.state = PARSER_STATE_WAIT_LOW;
-            }
-            break;
-
-        /* Waiting for low byte of 2-byte raw value */
-        case PARSER_STATE_WAIT_LOW:
-
-            /* Check if current byte is a valid low byte */
-            if ((byte & 0xC0) == 0x40) {
-                /* Stuff the high and low part of the raw value into an array */
-                parser.payload[0] = parser.lastByte;
-                parser.payload[1] = byte;
+int MindWaveController::initParser(uchar parserType, void *customData) {
+    return THINKGEAR_initParser(&parser, parserType, &MindWaveController::handleDataValue, customData);
+}
 
-                /* Notify the handler function of received raw value */
-                    parseSerialData(0, PARSER_CODE_RAW_SIGNAL, 2,
-                                             parser.payload,
-                                             parser.customData);
+int MindWaveController::parseByte(uchar byte) {
+    return THINKGEAR_parseByte(&parser, byte);
+}
 
-                returnValue = 1;
-            }
+//! \brief Forwards decoded values from the stream parser to the controller passed as customData
+void MindWaveController::handleDataValue(uchar extendedCodeLevel,
+                                         uchar code,
+                                         uchar valueLength,
+                                         const uchar *value,
+                                         void *customData) {
+    static_cast<MindWaveController*>(customData)->bufferDataValue(extendedCodeLevel, code,
+                                                                  valueLength, value);
+}
 
-            /* Return to start state waiting for high */
-            parser.state = PARSER_STATE_WAIT_HIGH;
+//! \brief Receives values released by the jitter buffer
+void MindWaveController::releaseDataValue(uchar extendedCodeLevel,
+                                          uchar code,
+                                          uchar valueLength,
+                                          const uchar *value,
+                                          void *customData) {
+    static_cast<MindWaveController*>(customData)->parseSerialData(extendedCodeLevel, code,
+                                                                  valueLength, value, customData);
+}
 
-            break;
+//! \brief Timestamp a decoded value and pass it through the jitter buffer
+//!
+//! Raw samples drive the headset clock estimate and are handled immediately, so the blink
+//! detector keeps its low latency.
+//!
+void MindWaveController::bufferDataValue(uchar extendedCodeLevel,
+                                         uchar code,
+                                         uchar valueLength,
+                                         const uchar *value) {
+    int64_t arrival = m_arrival;
 
-        /* unrecognized state */
-        default:
-            parser.state = PARSER_STATE_SYNC;
-            returnValue = -5;
-            break;
+    if (extendedCodeLevel == 0 && code == PARSER_CODE_RAW_SIGNAL) {
+        m_jitterBuffer.sampleArrived(arrival);
+        parseSerialData(extendedCodeLevel, code, valueLength, value, this);
+        return;
     }
 
-    /* Save current byte */
-    parser.lastByte = byte;
-
-    return returnValue;
+    m_jitterBuffer.push(extendedCodeLevel, code, valueLength, value, arrival);
+    scheduleJitterRelease();
 }
 
-int MindWaveController::parsePacketPayload() {
-    uchar i = 0;
-    uchar extendedCodeLevel = 0;
-    uchar code = 0;
-    uchar numBytes = 0;
-
-    /* Parse all bytes from the payload[] */
-    while (i < parser.payloadLength) {
-        /* Parse possible EXtended CODE bytes */
-        while (parser.payload[i] == PARSER_EXCODE_BYTE) {
-            extendedCodeLevel++;
-            i++;
-        }
-
-        /* Parse CODE */
-        code = parser.payload[i++];
-
-        /* Parse value length */
-        if (code >= 0x80) numBytes = parser.payload[i++];
-        else               numBytes = 1;
-
-        /* Call the callback function to handle the DataRow value */
-            parseSerialData(extendedCodeLevel, code, numBytes,
-                                     parser.payload+i, parser.customData);
-        i = static_cast<uchar>(i + numBytes);
+void MindWaveController::scheduleJitterRelease() {
+    if (!m_jitterBuffer.hasPending()) {
+        return;
     }
 
-    return 0;
+    // round up so the timer never fires before the value is due
+    int64_t wait = (m_jitterBuffer.nextReleaseTime() - monotonicMicros() + 999) / 1000;
+    m_jitterTimer.start(static_cast<int>(qMax<int64_t>(wait, 0)));
+}
+
+void MindWaveController::releaseJitterBuffer() {
+    m_jitterBuffer.releaseDue(monotonicMicros());
+    scheduleJitterRelease();
 }
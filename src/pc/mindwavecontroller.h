@@ -2,11 +2,16 @@
 #define MINDWAVECONTROLLER_H
 
 #include <QObject>
-#include <QSerialPort>
+#include <QTimer>
 #include <QVariantMap>
 #include <QDebug>
 
 #include "./defines.h"
+#include "./thinkgearstreamparser.h"
+#include "./channelhistory.h"
+#include "./blinkdetector.h"
+#include "./jitterbuffer.h"
+#include "./seriallink.h"
 
 //! \title MindWaveController Interface
 //!
@@ -17,7 +22,10 @@ class MindWaveController : public QObject {
 
     // Q_PROPERTY definitions for QML integration
     Q_PROPERTY(QString portName           MEMBER m_portName        READ getPortName       WRITE setPortName NOTIFY portNameChanged)
-    Q_PROPERTY(bool connected             MEMBER m_connectionState READ isConnected)
+    Q_PROPERTY(bool connected                                      READ isConnected       NOTIFY connectedChanged)
+    Q_PROPERTY(bool autoReconnect                                  READ getAutoReconnect  WRITE setAutoReconnect)
+    Q_PROPERTY(int silenceTimeout                                  READ getSilenceTimeout WRITE setSilenceTimeout)
+    Q_PROPERTY(int jitterBufferDelay                               READ getJitterBufferDelay WRITE setJitterBufferDelay)
 
     Q_PROPERTY(int batteryData            MEMBER m_batteryData     READ getBatteryData    NOTIFY batteryDataChanged)
     Q_PROPERTY(int signalData             MEMBER m_signalData      READ getSignalData     NOTIFY batteryDataChanged)
@@ -31,9 +39,28 @@ class MindWaveController : public QObject {
     Q_PROPERTY(QVariantMap asicEegData    MEMBER m_asicEegDataMap  READ getAsicEegData    NOTIFY asicEegDataChanged)
 
  public:
+    //! \brief Channels for which a sample history is kept
+    enum HistoryChannel {
+        SignalHistory = 0,
+        HeartRateHistory,
+        AttentionHistory,
+        MeditationHistory,
+        Raw16BitHistory,
+        RrIntervalHistory,
+        HistoryChannelCount
+    };
+
     explicit MindWaveController(QObject *parent = nullptr);
     ~MindWaveController();
 
+    // Shared per channel histories, read only so consumers cannot clear or resize them.
+    // Consumers register the windows they need with addWindow()
+    const ChannelHistory &history(HistoryChannel channel) const;
+    int addWindow(HistoryChannel channel, size_t length);
+
+    // Blink detection on the raw signal, configure through getBlinkDetector().setConfig()
+    BlinkDetector &getBlinkDetector();
+
  public slots:
     int initController(const QString portName);
 
@@ -43,7 +70,16 @@ class MindWaveController : public QObject {
     bool isConnected() const;
     int close();
 
-    void read();
+    bool getAutoReconnect() const;
+    void setAutoReconnect(bool enabled);
+    int  getSilenceTimeout() const;
+    void setSilenceTimeout(int msec);
+
+    int  getJitterBufferDelay() const;
+    void setJitterBufferDelay(int msec);
+    double getClockSkew() const;
+
+    void read(const QByteArray &data, qint64 arrival);
 
     // These allow data to be retrieved from the object
     uint16_t getBatteryData() const;
@@ -55,6 +91,8 @@ class MindWaveController : public QObject {
     uint16_t getRaw16BitData() const;
     uint16_t getRrIntervalData() const;
     QVariantMap  getEegPowerData();
+    const eegPowerData_t &getEegPowerValues() const;
+    const asicEegData_t  &getAsicEegValues() const;
     QVariantMap  getAsicEegData();
 
  signals:
@@ -63,6 +101,10 @@ class MindWaveController : public QObject {
 
     void portNameChanged(QString portName);  //! \brief Indicates the MindWaveMobile serial port has changed
 
+    void connectedChanged(bool connected);   //! \brief Indicates the connection state has changed
+    void connectionLost();                   //! \brief Indicates a port error or silence, a reconnect will be attempted
+    void reconnected();                      //! \brief Indicates the connection was recovered after being lost
+
     void batteryDataChanged(uint16_t data);  //! \brief Indicates a new battery level reading
     void signalDataChanged(uint16_t data);   //! \brief Indicates a new Signal Strength reading
 
@@ -75,16 +117,17 @@ class MindWaveController : public QObject {
 
     void rrIntervalDataChanged(uint16_t data);  //! \brief Indicates a new rrInterval reading
 
+    void blinkDetected(uint16_t strength);     //! \brief Indicates an eye blink in the raw signal
+    void artifactDetected(uint16_t strength);  //! \brief Indicates a non-blink artifact (movement, clipping) in the raw signal
+
     void eegPowerDataChanged(QVariantMap data);  //! \brief Indicates a new EEG reading reading
     void asicEegDataChanged(QVariantMap data);   //! \brief Indicates a new ASIC EEG reading reading
 
  private:
     QString m_portName;
-    QSerialPort serialPort;
+    SerialLink m_link;
     ThinkGearStreamParser parser;
 
-    bool m_connectionState  = false;
-
     uint16_t m_controllerID   = 0;
 
     uint16_t m_batteryData    = 0;
@@ -100,10 +143,23 @@ class MindWaveController : public QObject {
     eegPowerData_t m_eegPowerData;
     asicEegData_t  m_asicEegData;
 
+    ChannelHistory m_history[HistoryChannelCount];
+    BlinkDetector  m_blinkDetector;
+
+    JitterBuffer m_jitterBuffer;
+    QTimer m_jitterTimer;
+    int64_t m_arrival = 0;  // arrival time of the data being parsed
+    void bufferDataValue(uchar extendedCodeLevel,
+                         uchar code,
+                         uchar valueLength,
+                         const uchar *value);
+    void scheduleJitterRelease();
+
     QVariantMap m_eegPowerDataMap;
     QVariantMap m_asicEegDataMap;
     void convertEegPowerDataToVariant();
     void convertAsicEegDataToVariant();
+    static float decodeFloat(const uchar *value);
 
     void parseSerialData(uchar extendedCodeLevel,
                          uchar code,
@@ -111,11 +167,27 @@ class MindWaveController : public QObject {
                          const uchar *value,
                          void* /* Custom Data */);
 
-    void writeSerialData(const QByteArray &data);
+    static QByteArray buildPacket(const QByteArray &data);
 
+ private slots:
+    void handleConnectionLost();
+    void handleReconnected();
+    void releaseJitterBuffer();
+
+ private:
     int initParser(uchar parserType, void *customData);
     int parseByte(uchar byte);
-    int parsePacketPayload();
+
+    static void handleDataValue(uchar extendedCodeLevel,
+                                uchar code,
+                                uchar valueLength,
+                                const uchar *value,
+                                void *customData);
+    static void releaseDataValue(uchar extendedCodeLevel,
+                                 uchar code,
+                                 uchar valueLength,
+                                 const uchar *value,
+                                 void *customData);
 };
 
 #endif  // MINDWAVECONTROLLER_H
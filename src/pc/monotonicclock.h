@@ -0,0 +1,17 @@
+#ifndef MONOTONICCLOCK_H
+#define MONOTONICCLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+//! \brief Shared monotonic clock in microseconds
+//!
+//! Every timestamp passed between the serial links, the jitter buffers and the ping uses
+//! this clock, so times taken on different threads can be compared directly.
+//!
+inline int64_t monotonicMicros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif  // MONOTONICCLOCK_H
@@ -0,0 +1,344 @@
+#include "./seriallink.h"
+
+#include <cstring>
+
+#include "./monotonicclock.h"
+
+//! \brief Create a link and start its thread, name is used in debug output
+SerialLink::SerialLink(const QString &name, QObject *parent)
+    : QObject(parent), m_worker(new SerialLinkWorker(name)) {
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+
+    // signals from the worker are queued onto the owner's thread in the order they were sent
+    connect(m_worker, SIGNAL(dataReceived(QByteArray,qint64)), this, SIGNAL(dataReceived(QByteArray,qint64)));
+    connect(m_worker, SIGNAL(openFailed()), this, SIGNAL(openFailed()));
+    connect(m_worker, SIGNAL(connectedChanged(bool)), this, SLOT(updateConnectionState(bool)));
+    connect(m_worker, SIGNAL(connectionLost()), this, SIGNAL(connectionLost()));
+    connect(m_worker, SIGNAL(reconnected()), this, SIGNAL(reconnected()));
+
+    m_thread.start();
+}
+
+SerialLink::~SerialLink() {
+    // the worker closes its port as it is deleted on its own thread
+    m_thread.quit();
+    m_thread.wait();
+}
+
+//! \brief Open the port, blocking until it is open or has failed
+//!
+//! Returns 0 on success or 1 on failure. Only an explicit open blocks the caller, reconnects
+//! happen in the background on the link's thread.
+//!
+int SerialLink::open(const QString &portName, int baudRate) {
+    bool opened = false;
+    QMetaObject::invokeMethod(m_worker, "open", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, opened),
+                              Q_ARG(QString, portName), Q_ARG(int, baudRate));
+
+    if (opened) {
+        m_connectionState = true;
+    }
+
+    return opened ? 0 : 1;
+}
+
+//! \brief Close the port and cancel any pending reconnect
+void SerialLink::close() {
+    QMetaObject::invokeMethod(m_worker, "close", Qt::BlockingQueuedConnection);
+    m_connectionState = false;
+}
+
+bool SerialLink::isConnected() const {
+    return m_connectionState;
+}
+
+//! \brief Data written to the device after every open, after which the port is switched to baudRate
+void SerialLink::setHandshake(const QByteArray &data, int baudRate) {
+    QMetaObject::invokeMethod(m_worker, "setHandshake", Qt::QueuedConnection,
+                              Q_ARG(QByteArray, data), Q_ARG(int, baudRate));
+}
+
+bool SerialLink::getAutoReconnect() const {
+    return m_autoReconnect;
+}
+
+//! \brief Enable or disable reconnecting in the background after a port error or silence
+void SerialLink::setAutoReconnect(bool enabled) {
+    m_autoReconnect = enabled;
+    QMetaObject::invokeMethod(m_worker, "setAutoReconnect", Qt::QueuedConnection, Q_ARG(bool, enabled));
+}
+
+int SerialLink::getSilenceTimeout() const {
+    return m_silenceTimeout;
+}
+
+//! \brief Set how long a running device may go without showing it is alive (in ms) before it is treated as disconnected
+void SerialLink::setSilenceTimeout(int msec) {
+    m_silenceTimeout = msec;
+    QMetaObject::invokeMethod(m_worker, "setSilenceTimeout", Qt::QueuedConnection, Q_ARG(int, msec));
+}
+
+int SerialLink::getBootTimeout() const {
+    return m_bootTimeout;
+}
+
+//! \brief Set how long (in ms) a device may take after the port opens before it first shows it is alive
+void SerialLink::setBootTimeout(int msec) {
+    m_bootTimeout = msec;
+    QMetaObject::invokeMethod(m_worker, "setBootTimeout", Qt::QueuedConnection, Q_ARG(int, msec));
+}
+
+//! \brief Choose whether any received data shows the device is alive, or only markAlive()
+void SerialLink::setAliveOnData(bool enabled) {
+    QMetaObject::invokeMethod(m_worker, "setAliveOnData", Qt::QueuedConnection, Q_ARG(bool, enabled));
+}
+
+//! \brief Queue data to be written, this never blocks. Data written while disconnected is dropped.
+void SerialLink::write(const char *data, int length) {
+    if (!m_connectionState) {
+        return;  // port is closed while reconnecting
+    }
+
+    m_worker->enqueue(data, length);
+}
+
+//! \brief Report that the device has sent something valid, restarting the silence timeout
+void SerialLink::markAlive() {
+    QMetaObject::invokeMethod(m_worker, "markAlive", Qt::QueuedConnection);
+}
+
+void SerialLink::updateConnectionState(bool connected) {
+    m_connectionState = connected;
+    emit connectedChanged(connected);
+}
+
+SerialLinkWorker::SerialLinkWorker(const QString &name)
+    : m_name(name), m_port(this), m_watchdogTimer(this), m_reconnectTimer(this), m_flushTimer(this) {
+    connect(&m_port, SIGNAL(readyRead()), this, SLOT(read()));
+    connect(&m_port, SIGNAL(errorOccurred(QSerialPort::SerialPortError)),
+            this, SLOT(handleSerialError(QSerialPort::SerialPortError)));
+
+    connect(&m_watchdogTimer, SIGNAL(timeout()), this, SLOT(checkConnection()));
+    m_watchdogTimer.setInterval(WATCHDOG_INTERVAL);
+
+    connect(&m_reconnectTimer, SIGNAL(timeout()), this, SLOT(reconnect()));
+    m_reconnectTimer.setSingleShot(true);
+
+    // polling the buffer avoids posting an event (an allocation) for every write
+    connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    m_flushTimer.setInterval(SERIAL_LINK_TX_INTERVAL);
+}
+
+SerialLinkWorker::~SerialLinkWorker() {
+    m_watchdogTimer.stop();
+    m_reconnectTimer.stop();
+    m_flushTimer.stop();
+    m_port.close();
+}
+
+//! \brief Copy data into the transmit buffer for the next flush, safe to call from any thread
+void SerialLinkWorker::enqueue(const char *data, int length) {
+    QMutexLocker lock(&m_txMutex);
+
+    if (m_txLength + length > SERIAL_LINK_TX_BUFFER) {
+        qDebug() << m_name << "transmit buffer full, dropping" << length << "bytes";
+        return;
+    }
+
+    std::memcpy(m_txBuffer + m_txLength, data, length);
+    m_txLength += length;
+}
+
+//! \brief Hand the transmit buffer to the port, which sends it as the device accepts it
+void SerialLinkWorker::flush() {
+    QMutexLocker lock(&m_txMutex);
+
+    if (m_connectionState && m_txLength) {
+        qint64 bytesWritten = m_port.write(m_txBuffer, m_txLength);
+
+        if (bytesWritten == -1) {
+            qDebug() << m_name << "failed to write the data to port";
+        } else if (bytesWritten != m_txLength) {
+            qDebug() << m_name << "failed to write all the data to port";
+        }
+    }
+
+    m_txLength = 0;
+}
+
+bool SerialLinkWorker::open(const QString &portName, int baudRate) {
+    // a deliberate open replaces any reconnect in progress
+    m_reconnectTimer.stop();
+    m_reconnecting = false;
+
+    m_portName = portName;
+    m_baudRate = baudRate;
+
+    return openPort();
+}
+
+void SerialLinkWorker::close() {
+    m_watchdogTimer.stop();
+    m_reconnectTimer.stop();
+    m_flushTimer.stop();
+    m_reconnecting = false;
+
+    m_port.close();
+
+    if (m_connectionState) {
+        m_connectionState = false;
+        emit connectedChanged(false);
+    }
+}
+
+void SerialLinkWorker::setHandshake(const QByteArray &data, int baudRate) {
+    m_handshake = data;
+    m_handshakeBaudRate = baudRate;
+}
+
+void SerialLinkWorker::setAutoReconnect(bool enabled) {
+    m_autoReconnect = enabled;
+
+    if (!enabled) {
+        m_reconnectTimer.stop();
+        m_reconnecting = false;
+    }
+}
+
+void SerialLinkWorker::setSilenceTimeout(int msec) {
+    m_silenceTimeout = msec;
+}
+
+void SerialLinkWorker::setBootTimeout(int msec) {
+    m_bootTimeout = msec;
+}
+
+void SerialLinkWorker::setAliveOnData(bool enabled) {
+    m_aliveOnData = enabled;
+}
+
+void SerialLinkWorker::markAlive() {
+    m_alive = true;
+    m_lastDataTimer.restart();
+}
+
+void SerialLinkWorker::read() {
+    QByteArray data = m_port.readAll();
+    if (data.isEmpty()) {
+        return;
+    }
+
+    if (m_aliveOnData) {
+        markAlive();
+    }
+
+    emit dataReceived(data, monotonicMicros());
+}
+
+//! \brief Treat fatal port errors as a lost connection
+void SerialLinkWorker::handleSerialError(QSerialPort::SerialPortError error) {
+    switch (error) {
+    case QSerialPort::NoError:
+    case QSerialPort::TimeoutError:
+        return;
+
+    default:
+        qDebug() << m_name << "port error: " << error;
+        if (m_connectionState) {
+            handleConnectionLost();
+        }
+        break;
+    }
+}
+
+//! \brief Periodically check that the device is still alive
+//!
+//! Until the device first shows it is alive after an open the boot timeout applies instead of
+//! the silence timeout, as opening the port may have reset it.
+//!
+void SerialLinkWorker::checkConnection() {
+    if (!m_connectionState) {
+        return;
+    }
+
+    int timeout = m_alive ? m_silenceTimeout : m_bootTimeout;
+    if (m_lastDataTimer.elapsed() > timeout) {
+        qDebug() << m_name << (m_alive ? "silent for" : "did not start within") << m_lastDataTimer.elapsed() << "ms";
+        handleConnectionLost();
+    }
+}
+
+void SerialLinkWorker::handleConnectionLost() {
+    // clear the state first as closing the port may report further errors
+    m_connectionState = false;
+    m_watchdogTimer.stop();
+    m_flushTimer.stop();
+    m_port.close();
+
+    emit connectedChanged(false);
+    emit connectionLost();
+
+    if (m_autoReconnect) {
+        m_reconnecting = true;
+        m_reconnectDelay = RECONNECT_INITIAL_DELAY;
+        m_reconnectTimer.start(m_reconnectDelay);
+    }
+}
+
+//! \brief Reopen the port and redo the handshake, backing off on failure
+void SerialLinkWorker::reconnect() {
+    if (!m_reconnecting) {
+        return;
+    }
+
+    if (!openPort()) {
+        m_reconnectDelay = qMin(m_reconnectDelay * 2, RECONNECT_MAX_DELAY);
+        m_reconnectTimer.start(m_reconnectDelay);
+        return;
+    }
+
+    qDebug() << m_name << "reconnected on" << m_portName;
+    m_reconnecting = false;
+    emit reconnected();
+}
+
+bool SerialLinkWorker::openPort() {
+    m_port.setPortName(m_portName);
+    m_port.setBaudRate(m_baudRate);
+
+    if (m_port.isOpen()) {
+        m_port.close();
+    }
+
+    if (!m_port.open(QIODevice::ReadWrite)) {
+        qDebug() << m_name << "failed to open serial port" << m_portName;
+        emit openFailed();
+        return false;
+    }
+
+    // drop anything queued for the previous connection
+    {
+        QMutexLocker lock(&m_txMutex);
+        m_txLength = 0;
+    }
+
+    if (!m_handshake.isEmpty()) {
+        // only this link's thread waits for the handshake to go out
+        m_port.write(m_handshake);
+        if (!m_port.waitForBytesWritten(1000)) {
+            qDebug() << m_name << "handshake timed out or an error occurred";
+        }
+        m_port.setBaudRate(m_handshakeBaudRate);
+    }
+
+    m_connectionState = true;
+    m_alive = false;
+    m_lastDataTimer.start();
+    m_watchdogTimer.start();
+    m_flushTimer.start();
+    emit connectedChanged(true);
+
+    return true;
+}
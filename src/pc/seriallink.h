@@ -0,0 +1,146 @@
+#ifndef SERIALLINK_H
+#define SERIALLINK_H
+
+#include <QObject>
+#include <QSerialPort>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QTimer>
+#include <QDebug>
+
+#include "./defines.h"
+
+#define SERIAL_LINK_TX_BUFFER   4096  /* Bytes queued for writing between flushes */
+#define SERIAL_LINK_TX_INTERVAL 2     /* Time (in ms) between flushes of the transmit buffer */
+
+class SerialLinkWorker;
+
+//! \title SerialLink
+//!
+//! \brief A serial port run on its own thread which keeps itself connected.
+//!
+//! Opening a port (a Bluetooth port can block for seconds) and the device handshake happen on
+//! the link's thread, so one device reconnecting never stalls the event loop serving the
+//! others. Writes are copied into a fixed buffer which the link's thread drains every
+//! SERIAL_LINK_TX_INTERVAL ms while connected, so writing never blocks or allocates.
+//!
+//! The link treats port errors and silence as a lost connection and reopens the port with an
+//! exponential backoff. Silence is only timed once the device is alive after an open, so a
+//! board which resets when the port opens is given bootTimeout to start up. By default any
+//! data shows the device is alive; owners which need a valid frame instead disable this with
+//! setAliveOnData(false) and call markAlive() for each frame.
+//!
+class SerialLink : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit SerialLink(const QString &name, QObject *parent = nullptr);
+    ~SerialLink();
+
+    int open(const QString &portName, int baudRate);
+    void close();
+    bool isConnected() const;
+
+    void setHandshake(const QByteArray &data, int baudRate);
+
+    bool getAutoReconnect() const;
+    void setAutoReconnect(bool enabled);
+    int  getSilenceTimeout() const;
+    void setSilenceTimeout(int msec);
+    int  getBootTimeout() const;
+    void setBootTimeout(int msec);
+    void setAliveOnData(bool enabled);
+
+    void write(const char *data, int length);
+    void markAlive();
+
+ signals:
+    void dataReceived(QByteArray data, qint64 arrival);  //! \brief Data read from the port, arrival on the monotonicMicros() clock
+    void openFailed();                      //! \brief Indicates an attempt to open the port failed
+    void connectedChanged(bool connected);  //! \brief Indicates the connection state has changed
+    void connectionLost();                  //! \brief Indicates a port error or silence, a reconnect will be attempted
+    void reconnected();                     //! \brief Indicates the connection was recovered after being lost
+
+ private slots:
+    void updateConnectionState(bool connected);
+
+ private:
+    QThread m_thread;
+    SerialLinkWorker *m_worker;
+
+    bool m_connectionState = false;
+    bool m_autoReconnect   = true;
+    int  m_silenceTimeout  = 500;
+    int  m_bootTimeout     = 3000;
+};
+
+//! \brief Owns the port of a SerialLink, every slot runs on the link's thread
+class SerialLinkWorker : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit SerialLinkWorker(const QString &name);
+    ~SerialLinkWorker();
+
+    void enqueue(const char *data, int length);
+
+ signals:
+    void dataReceived(QByteArray data, qint64 arrival);
+    void openFailed();
+    void connectedChanged(bool connected);
+    void connectionLost();
+    void reconnected();
+
+ public slots:
+    bool open(const QString &portName, int baudRate);
+    void close();
+
+    void setHandshake(const QByteArray &data, int baudRate);
+    void setAutoReconnect(bool enabled);
+    void setSilenceTimeout(int msec);
+    void setBootTimeout(int msec);
+    void setAliveOnData(bool enabled);
+    void markAlive();
+
+ private slots:
+    void flush();
+    void read();
+    void handleSerialError(QSerialPort::SerialPortError error);
+    void checkConnection();
+    void reconnect();
+
+ private:
+    QString m_name;
+    QSerialPort m_port;
+
+    QString m_portName;
+    int     m_baudRate = QSerialPort::Baud9600;
+
+    QByteArray m_handshake;
+    int        m_handshakeBaudRate = QSerialPort::Baud9600;
+
+    bool m_connectionState = false;
+    bool m_autoReconnect   = true;
+    bool m_reconnecting    = false;
+    bool m_aliveOnData     = true;
+    bool m_alive           = false;  // the device has shown it is running since the port opened
+    int  m_silenceTimeout  = 500;
+    int  m_bootTimeout     = 3000;
+    int  m_reconnectDelay  = RECONNECT_INITIAL_DELAY;
+
+    QElapsedTimer m_lastDataTimer;
+    QTimer m_watchdogTimer;
+    QTimer m_reconnectTimer;
+    QTimer m_flushTimer;
+
+    // written from the owner's thread, drained by flush() on the link's thread
+    QMutex m_txMutex;
+    char   m_txBuffer[SERIAL_LINK_TX_BUFFER];
+    int    m_txLength = 0;
+
+    bool openPort();
+    void handleConnectionLost();
+};
+
+#endif  // SERIALLINK_H
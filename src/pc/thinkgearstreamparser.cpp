@@ -0,0 +1,168 @@
+#include "./thinkgearstreamparser.h"
+
+static int parsePacketPayload(ThinkGearStreamParser *parser);
+
+int THINKGEAR_initParser(ThinkGearStreamParser *parser,
+                         uchar parserType,
+                         ThinkGearDataHandler handleDataValue,
+                         void *customData) {
+    if (!parser) return( -1 );
+
+    /* Initialize the parser's state based on the parser type */
+    switch (parserType) {
+        case PARSER_TYPE_PACKETS:
+            parser->state = PARSER_STATE_SYNC;
+            break;
+        case PARSER_TYPE_2BYTERAW:
+            parser->state = PARSER_STATE_WAIT_HIGH;
+            break;
+        default: return( -2 );
+    }
+
+    /* Save parser type */
+    parser->type = parserType;
+
+    /* Save user-defined handler function and data pointer */
+    parser->handleDataValue = handleDataValue;
+    parser->customData = customData;
+
+    return 0;
+}
+
+int THINKGEAR_parseByte(ThinkGearStreamParser *parser, uchar byte) {
+    if (!parser) return( -1 );
+
+    int returnValue = 0;
+
+    /* Pick handling according to current state... */
+    switch (parser->state) {
+        /* Waiting for SyncByte */
+        case PARSER_STATE_SYNC:
+            if (byte == PARSER_SYNC_BYTE) {
+                parser->state = PARSER_STATE_SYNC_CHECK;
+            }
+            break;
+
+        /* Waiting for second SyncByte */
+        case PARSER_STATE_SYNC_CHECK:
+            if (byte == PARSER_SYNC_BYTE) {
+                parser->state = PARSER_STATE_PAYLOAD_LENGTH;
+            } else {
+                parser->state = PARSER_STATE_SYNC;
+            }
+            break;
+
+        /* Waiting for Data[] length */
+        case PARSER_STATE_PAYLOAD_LENGTH:
+            parser->payloadLength = byte;
+            if (parser->payloadLength > 170) {
+                parser->state = PARSER_STATE_SYNC;
+                returnValue = -3;
+            } else if (parser->payloadLength == 170) {
+                returnValue = -4;
+            } else {
+                parser->payloadBytesReceived = 0;
+                parser->payloadSum = 0;
+                parser->state = PARSER_STATE_PAYLOAD;
+            }
+            break;
+
+        /* Waiting for Payload[] bytes */
+        case PARSER_STATE_PAYLOAD:
+            parser->payload[parser->payloadBytesReceived++] = byte;
+            parser->payloadSum = static_cast<uchar>(parser->payloadSum + byte);
+            if (parser->payloadBytesReceived >= parser->payloadLength) {
+                parser->state = PARSER_STATE_CHKSUM;
+            }
+            break;
+
+        /* Waiting for CKSUM byte */
+        case PARSER_STATE_CHKSUM:
+            parser->chksum = byte;
+            parser->state = PARSER_STATE_SYNC;
+            if (parser->chksum != ((~parser->payloadSum)&0xFF)) {
+                returnValue = -2;
+            } else {
+                returnValue = 1;
+                parsePacketPayload(parser);
+            }
+            break;
+
+        /* Waiting for high byte of 2-byte raw value */
+        case PARSER_STATE_WAIT_HIGH:
+
+            /* Check if current byte is a high byte */
+            if ((byte & 0xC0) == 0x80) {
+                /* High byte recognized, will be saved as parser->lastByte */
+                parser->state = PARSER_STATE_WAIT_LOW;
+            }
+            break;
+
+        /* Waiting for low byte of 2-byte raw value */
+        case PARSER_STATE_WAIT_LOW:
+
+            /* Check if current byte is a valid low byte */
+            if ((byte & 0xC0) == 0x40) {
+                /* Stuff the high and low part of the raw value into an array */
+                parser->payload[0] = parser->lastByte;
+                parser->payload[1] = byte;
+
+                /* Notify the handler function of received raw value */
+                if (parser->handleDataValue) {
+                    parser->handleDataValue(0, PARSER_CODE_RAW_SIGNAL, 2,
+                                            parser->payload,
+                                            parser->customData);
+                }
+
+                returnValue = 1;
+            }
+
+            /* Return to start state waiting for high */
+            parser->state = PARSER_STATE_WAIT_HIGH;
+
+            break;
+
+        /* unrecognized state */
+        default:
+            parser->state = PARSER_STATE_SYNC;
+            returnValue = -5;
+            break;
+    }
+
+    /* Save current byte */
+    parser->lastByte = byte;
+
+    return returnValue;
+}
+
+static int parsePacketPayload(ThinkGearStreamParser *parser) {
+    uchar i = 0;
+    uchar extendedCodeLevel = 0;
+    uchar code = 0;
+    uchar numBytes = 0;
+
+    /* Parse all bytes from the payload[] */
+    while (i < parser->payloadLength) {
+        /* Parse possible EXtended CODE bytes */
+        while (parser->payload[i] == PARSER_EXCODE_BYTE) {
+            extendedCodeLevel++;
+            i++;
+        }
+
+        /* Parse CODE */
+        code = parser->payload[i++];
+
+        /* Parse value length */
+        if (code >= 0x80) numBytes = parser->payload[i++];
+        else               numBytes = 1;
+
+        /* Call the callback function to handle the DataRow value */
+        if (parser->handleDataValue) {
+            parser->handleDataValue(extendedCodeLevel, code, numBytes,
+                                    parser->payload+i, parser->customData);
+        }
+        i = static_cast<uchar>(i + numBytes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef THINKGEARSTREAMPARSER_H
+#define THINKGEARSTREAMPARSER_H
+
+#include "./defines.h"
+
+//! \brief Initialise a parser of the given type (PARSER_TYPE_PACKETS or PARSER_TYPE_2BYTERAW)
+//!
+//! handleDataValue is called with customData for every DataRow decoded from a packet with a
+//! valid checksum. Returns 0 on success, -1 for a NULL parser or -2 for an unknown type.
+//!
+int THINKGEAR_initParser(ThinkGearStreamParser *parser,
+                         uchar parserType,
+                         ThinkGearDataHandler handleDataValue,
+                         void *customData);
+
+//! \brief Feed one byte of the stream to the parser
+//!
+//! Returns 1 when a packet (or raw value) was completed, 0 while more bytes are needed, -2 on
+//! a checksum mismatch, -3 for an invalid payload length and -4/-5 for other framing errors.
+//!
+int THINKGEAR_parseByte(ThinkGearStreamParser *parser, uchar byte);
+
+#endif  // THINKGEARSTREAMPARSER_H